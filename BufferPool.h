@@ -0,0 +1,173 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_BUFFERPOOL_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+///A thread-safe pool of byte buffers in power-of-two size classes, for per-tile working memory
+//
+///Tiles come in a few repeating sizes, so once each size class has been used, later tiles
+///take their buffers from the pool instead of allocating (and page-faulting) new ones.
+///A buffer is returned when its Lease goes out of scope. The pool keeps at most
+///maxPerClass free buffers of each size class; more are freed.
+class BufferPool {
+public:
+    typedef std::vector<std::uint8_t> Buffer;
+
+    ///Pool occupancy and reuse since construction
+    struct Stats {
+        ///Free buffers held by the pool, and their total capacity
+        std::size_t freeBuffers;
+        std::size_t freeBytes;
+        ///Buffers currently leased
+        std::size_t leasedBuffers;
+        ///Leases served from the pool, and those that had to allocate
+        std::size_t hits;
+        std::size_t misses;
+    };
+
+    ///A buffer on loan from the pool, of the requested size
+    class Lease {
+    public:
+        Lease(BufferPool &_pool, Buffer &&_buffer) :
+            m_pool(&_pool),
+            m_buffer(std::move(_buffer))
+        {
+        }//end constructor
+
+        Lease(Lease &&_other) :
+            m_pool(_other.m_pool),
+            m_buffer(std::move(_other.m_buffer))
+        {
+            _other.m_pool = nullptr;
+        }//end move constructor
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        virtual ~Lease(void) {
+            if (nullptr != m_pool) {
+                m_pool->Release(std::move(m_buffer));
+            }
+        }//end destructor
+
+        inline Buffer& Get() { return m_buffer; }
+
+    private:
+        BufferPool *m_pool;
+        Buffer m_buffer;
+    };
+
+public:
+    ///Constructor: the largest number of free buffers kept per size class
+    explicit BufferPool(const std::size_t &_maxPerClass = 16) :
+        m_maxPerClass(_maxPerClass),
+        m_free(),
+        m_stats({ 0, 0, 0, 0, 0 })
+    {
+    }//end constructor
+
+    virtual ~BufferPool(void) {
+    }//end destructor
+
+    ///Lease a buffer of _size bytes. Its contents are not cleared.
+    Lease Acquire(const std::size_t &_size) {
+        std::size_t capacity = GetClassSize(_size);
+        Buffer buffer;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<Buffer> &free = m_free[capacity];
+            if (!free.empty()) {
+                buffer = std::move(free.back());
+                free.pop_back();
+                m_stats.freeBuffers--;
+                m_stats.freeBytes -= capacity;
+                m_stats.hits++;
+            }
+            else {
+                m_stats.misses++;
+            }
+            m_stats.leasedBuffers++;
+        }
+        //Allocate outside the lock; a pooled buffer already has the capacity, so this does not allocate
+        buffer.reserve(capacity);
+        buffer.resize(_size);
+        return Lease(*this, std::move(buffer));
+    }//end Acquire
+
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }//end GetStats
+
+    ///Free every pooled buffer
+    void Clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.clear();
+        m_stats.freeBuffers = 0;
+        m_stats.freeBytes = 0;
+    }//end Clear
+
+private:
+    ///Return a leased buffer to its size class, or free it if the class is full
+    void Release(Buffer &&_buffer) {
+        std::size_t capacity = _buffer.capacity();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.leasedBuffers--;
+        if (capacity != GetClassSize(capacity)) {
+            return;
+        }
+        std::vector<Buffer> &free = m_free[capacity];
+        if (free.size() < m_maxPerClass) {
+            free.push_back(std::move(_buffer));
+            m_stats.freeBuffers++;
+            m_stats.freeBytes += capacity;
+        }
+    }//end Release
+
+    ///Smallest power of two at or above _size (at least 4 kB)
+    inline static std::size_t GetClassSize(const std::size_t &_size) {
+        std::size_t capacity = 4096;
+        while (capacity < _size) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }//end GetClassSize
+
+private:
+    std::size_t m_maxPerClass;
+    ///Free buffers of each size class, by capacity
+    std::map<std::size_t, std::vector<Buffer>> m_free;
+    Stats m_stats;
+    mutable std::mutex m_mutex;
+};//end class BufferPool
+
+#endif
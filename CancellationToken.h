@@ -0,0 +1,72 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_CANCELLATIONTOKEN_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <cstdint>
+
+///Lets long-running tile jobs on other threads find out that their result is no longer wanted
+//
+///Work belongs to the generation that was current when it started. Cancel() starts a new
+///generation, so every job of the earlier ones is stale. The token is only an atomic
+///counter, so the thread that owns the work (e.g. on a stop request) can cancel it
+///without the jobs calling back into their owner. Jobs poll IsCancelled() every
+///GetCheckRows() rows, so abandoned work stops within a few rows instead of running
+///to the end of the tile.
+class CancellationToken {
+public:
+    CancellationToken() :
+        m_generation(0)
+    {
+    }//end constructor
+
+    virtual ~CancellationToken(void) {
+    }//end destructor
+
+    ///The generation of work started now
+    inline std::uint64_t GetGeneration() const {
+        return m_generation.load(std::memory_order_acquire);
+    }//end GetGeneration
+
+    ///Make the work of all earlier generations stale, and return the new generation
+    inline std::uint64_t Cancel() {
+        return m_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }//end Cancel
+
+    ///Whether work of a generation should stop because it is stale
+    inline bool IsCancelled(const std::uint64_t &_generation) const {
+        return _generation != GetGeneration();
+    }//end IsCancelled
+
+public:
+    ///Number of rows of a tile processed between calls to IsCancelled()
+    inline static const int GetCheckRows() { return 16; }
+
+private:
+    std::atomic<std::uint64_t> m_generation;
+};//end class CancellationToken
+
+#endif
@@ -0,0 +1,159 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_COLORLUT_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_COLORLUT_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+///A retain/reject decision for every 8-bit RGB triple, stored as a 256^3 bit table (2 MB)
+//
+///Any color rule, e.g. one combining OD magnitude with hue, is evaluated once per
+///possible color when the table is built; applying it then costs one lookup per pixel.
+///The table can be built from a rule, in parallel over the red values, or trained
+///from labeled sample pixels.
+class ColorLUT {
+public:
+    ///Returns whether an RGB triple is retained
+    typedef std::function<bool(int, int, int)> Rule;
+
+public:
+    ColorLUT() :
+        m_bits(static_cast<std::size_t>(1) << 18, 0)
+    {
+    }//end constructor
+
+    virtual ~ColorLUT(void) {
+    }//end destructor
+
+    ///Retain/reject decision of an RGB triple (each 0 to 255)
+    inline bool IsRetained(const int &_r, const int &_g, const int &_b) const {
+        std::size_t index = GetIndex(_r, _g, _b);
+        return 0 != ((m_bits[index >> 6] >> (index & 63)) & 1);
+    }//end IsRetained
+
+    ///Evaluate a rule for every RGB triple, split across threads by red value
+    //
+    ///\param _rule: must be safe to call from several threads at once
+    ///\param _numThreads: 0 to use the number of hardware threads
+    void Build(const Rule &_rule, int _numThreads = 0) {
+        if (_numThreads <= 0) {
+            _numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        }
+        _numThreads = std::min(_numThreads, 256);
+        //Each red value fills 1024 whole words, so threads never share a word
+        auto fillReds = [&](int firstRed, int step) {
+            for (int r = firstRed; r < 256; r += step) {
+                for (int g = 0; g < 256; g++) {
+                    for (int b = 0; b < 256; b += 64) {
+                        std::uint64_t word = 0;
+                        for (int i = 0; i < 64; i++) {
+                            word |= static_cast<std::uint64_t>(_rule(r, g, b + i) ? 1 : 0) << i;
+                        }
+                        m_bits[GetIndex(r, g, b) >> 6] = word;
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int t = 1; t < _numThreads; t++) {
+            threads.emplace_back(fillReds, t, _numThreads);
+        }
+        fillReds(0, _numThreads);
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }//end Build
+
+    ///Build the table from labeled sample pixels
+    //
+    ///Samples vote in a 64^3 grid of colors (4 values per step). A cell is retained if it
+    ///has more retained than rejected votes. Cells without votes, or with a tie, take the
+    ///decision of the nearest cell (6-connected) that has one. No samples rejects every color.
+    void Train(const std::vector<std::array<int, 3>> &_retained, 
+        const std::vector<std::array<int, 3>> &_rejected, int _numThreads = 0) {
+        const int cells = 64;
+        std::vector<int> votes(static_cast<std::size_t>(cells) * cells * cells, 0);
+        for (const auto &rgb : _retained) { votes[GetCell(rgb)]++; }
+        for (const auto &rgb : _rejected) { votes[GetCell(rgb)]--; }
+        //Spread the decisions of cells with votes breadth-first into the others
+        std::vector<std::int8_t> label(votes.size(), -1);
+        std::vector<int> queue;
+        for (std::size_t c = 0; c < votes.size(); c++) {
+            if (votes[c] != 0) {
+                label[c] = (votes[c] > 0) ? 1 : 0;
+                queue.push_back(static_cast<int>(c));
+            }
+        }
+        if (queue.empty()) {
+            std::fill(m_bits.begin(), m_bits.end(), 0);
+            return;
+        }
+        const int neighbors[6][3] = { {-1,0,0},{1,0,0},{0,-1,0},{0,1,0},{0,0,-1},{0,0,1} };
+        for (std::size_t head = 0; head < queue.size(); head++) {
+            int c = queue[head];
+            int x = c % cells, y = (c / cells) % cells, z = c / (cells * cells);
+            for (const auto &n : neighbors) {
+                int nx = x + n[0], ny = y + n[1], nz = z + n[2];
+                if ((nx < 0) || (ny < 0) || (nz < 0) || (nx >= cells) || (ny >= cells) || (nz >= cells)) {
+                    continue;
+                }
+                int nc = (nz * cells + ny) * cells + nx;
+                if (label[nc] < 0) {
+                    label[nc] = label[c];
+                    queue.push_back(nc);
+                }
+            }
+        }
+        Build([&](int r, int g, int b) { 
+            return 1 == label[GetCell({ r, g, b })]; 
+        }, _numThreads);
+    }//end Train
+
+private:
+    inline static std::size_t GetIndex(const int &_r, const int &_g, const int &_b) {
+        return (static_cast<std::size_t>(_r) << 16) | (static_cast<std::size_t>(_g) << 8) 
+            | static_cast<std::size_t>(_b);
+    }//end GetIndex
+
+    ///Cell of the 64^3 training grid (blue fastest)
+    inline static std::size_t GetCell(const std::array<int, 3> &_rgb) {
+        std::array<int, 3> c;
+        for (int ch = 0; ch < 3; ch++) {
+            c[ch] = std::min(255, std::max(0, _rgb[ch])) >> 2;
+        }
+        return (static_cast<std::size_t>(c[0]) * 64 + c[1]) * 64 + c[2];
+    }//end GetCell
+
+private:
+    ///One bit per RGB triple, 64 blue values per word
+    std::vector<std::uint64_t> m_bits;
+};//end class ColorLUT
+
+#endif
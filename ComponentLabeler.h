@@ -0,0 +1,247 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_COMPONENTLABELER_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_COMPONENTLABELER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+///Labels the 8-connected components of a binary mask that arrives one tile at a time
+//
+///Tiles must be added in raster order: tile rows from top to bottom, and tiles
+///from left to right within a row, all tiles of a row having the same height.
+///Labels are merged across tile seams with a union-find. Only the labels of the
+///bottom row of the previous tile row and the right column of the previous tile
+///are kept, so memory is bounded by the seams and one tile row of labels rather
+///than by the size of the region. When a tile row is finished, every component
+///that does not reach its bottom row is complete and is passed to the visitor.
+class ComponentLabeler {
+public:
+    ///Measurements of a connected component, in region pixel coordinates
+    struct Component {
+        std::int64_t area;
+        ///Sums of the pixel x and y coordinates, for the centroid
+        double sumX;
+        double sumY;
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+        ///Number of pixel edges between the component and the background or region edge
+        std::int64_t perimeter;
+
+        inline double GetCentroidX() const { return (area > 0) ? sumX / area : 0.0; }
+        inline double GetCentroidY() const { return (area > 0) ? sumY / area : 0.0; }
+    };
+
+    typedef std::function<void(const Component&)> ComponentVisitor;
+
+public:
+    ///Constructor: width of the region, and the function called for each completed component
+    ComponentLabeler(const int &_width, const ComponentVisitor &_visitor) :
+        m_width(_width),
+        m_visitor(_visitor),
+        m_rowY(0),
+        m_bottomRow(_width, 0),
+        m_nextBottomRow(_width, 0),
+        m_rightColumn(),
+        m_parents(1, 0),
+        m_components(1)
+    {
+    }//end constructor
+
+    virtual ~ComponentLabeler(void) {
+    }//end destructor
+
+    ///Label a tile of the mask (row-major, nonzero is foreground) at its position relative to the region
+    void AddTile(const int &_x, const int &_y, const int &_width, const int &_height,
+        const std::vector<std::uint8_t> &_mask) {
+        if (_y != m_rowY) {
+            //A new tile row: everything above its top row is final
+            FinishRow();
+            m_rowY = _y;
+        }
+        if (0 == _x) {
+            m_rightColumn.assign(_height, 0);
+        }
+
+        std::vector<int> labels(static_cast<std::size_t>(_width) * _height, 0);
+        for (int ty = 0; ty < _height; ty++) {
+            for (int tx = 0; tx < _width; tx++) {
+                if (0 == _mask[ty*_width + tx]) { continue; }
+                int gx = _x + tx;
+                int gy = _y + ty;
+                //West and north neighbors share an edge, the others only a corner
+                int west = GetLabel(labels, _x, _width, tx - 1, ty);
+                int north = GetLabel(labels, _x, _width, tx, ty - 1);
+                int northWest = GetLabel(labels, _x, _width, tx - 1, ty - 1);
+                int northEast = GetLabel(labels, _x, _width, tx + 1, ty - 1);
+                //The previous tile's pixel below and to the left was labeled before this one
+                int southWest = ((0 == tx) && (ty + 1 < _height)) ? GetLabel(labels, _x, _width, tx - 1, ty + 1) : 0;
+
+                int label = 0;
+                for (int neighbor : { west, north, northWest, northEast, southWest }) {
+                    if (0 == neighbor) { continue; }
+                    label = (0 == label) ? Find(neighbor) : Union(label, neighbor);
+                }
+                if (0 == label) {
+                    label = NewLabel();
+                }
+                labels[ty*_width + tx] = label;
+
+                Component &c = m_components[label];
+                c.area++;
+                c.sumX += gx;
+                c.sumY += gy;
+                c.minX = std::min(c.minX, gx);
+                c.minY = std::min(c.minY, gy);
+                c.maxX = std::max(c.maxX, gx);
+                c.maxY = std::max(c.maxY, gy);
+                //Each edge shared with a foreground pixel is not part of the perimeter
+                c.perimeter += 4 - 2 * ((0 != west) ? 1 : 0) - 2 * ((0 != north) ? 1 : 0);
+            }
+        }
+
+        //Keep the seams for the next tile and the next tile row
+        for (int ty = 0; ty < _height; ty++) {
+            m_rightColumn[ty] = labels[ty*_width + _width - 1];
+        }
+        std::copy(labels.end() - _width, labels.end(), m_nextBottomRow.begin() + _x);
+    }//end AddTile
+
+    ///Report the components that are still open, once all tiles have been added
+    void Finish() {
+        FinishRow();
+        //An empty row below the region closes the components that reach its bottom
+        FinishRow();
+    }//end Finish
+
+private:
+    ///Label of a tile pixel, or of a seam pixel when outside the tile (0 is background)
+    inline int GetLabel(const std::vector<int> &_labels, const int &_tileX, const int &_tileWidth,
+        const int &_tx, const int &_ty) const {
+        int gx = _tileX + _tx;
+        if ((gx < 0) || (gx >= m_width)) { return 0; }
+        if (_ty < 0) { return m_bottomRow[gx]; }
+        if (_tx < 0) { return m_rightColumn[_ty]; }
+        //The east neighbor in the row above is only labeled once the next tile is added
+        if (_tx >= _tileWidth) { return 0; }
+        return _labels[_ty*_tileWidth + _tx];
+    }//end GetLabel
+
+    inline int NewLabel() {
+        int label = static_cast<int>(m_parents.size());
+        m_parents.push_back(label);
+        Component c;
+        c.area = 0;
+        c.sumX = c.sumY = 0.0;
+        c.minX = c.minY = std::numeric_limits<int>::max();
+        c.maxX = c.maxY = std::numeric_limits<int>::min();
+        c.perimeter = 0;
+        m_components.push_back(c);
+        return label;
+    }//end NewLabel
+
+    inline int Find(int _label) {
+        while (m_parents[_label] != _label) {
+            m_parents[_label] = m_parents[m_parents[_label]];
+            _label = m_parents[_label];
+        }
+        return _label;
+    }//end Find
+
+    ///Merge two labels, returning the root. The root holds the combined measurements.
+    inline int Union(const int &_a, const int &_b) {
+        int rootA = Find(_a);
+        int rootB = Find(_b);
+        if (rootA == rootB) { return rootA; }
+        int root = std::min(rootA, rootB);
+        int child = std::max(rootA, rootB);
+        m_parents[child] = root;
+        Component &r = m_components[root];
+        const Component &c = m_components[child];
+        r.area += c.area;
+        r.sumX += c.sumX;
+        r.sumY += c.sumY;
+        r.minX = std::min(r.minX, c.minX);
+        r.minY = std::min(r.minY, c.minY);
+        r.maxX = std::max(r.maxX, c.maxX);
+        r.maxY = std::max(r.maxY, c.maxY);
+        r.perimeter += c.perimeter;
+        return root;
+    }//end Union
+
+    ///Report the components that do not reach the bottom of the finished tile row,
+    ///and renumber the open ones so the label tables only hold the seam
+    void FinishRow() {
+        //The finished row's bottom becomes the seam above the next row
+        m_bottomRow.swap(m_nextBottomRow);
+        std::fill(m_nextBottomRow.begin(), m_nextBottomRow.end(), 0);
+
+        std::unordered_map<int, int> openRoots;
+        std::vector<int> parents(1, 0);
+        std::vector<Component> components(1);
+        for (auto &label : m_bottomRow) {
+            if (0 == label) { continue; }
+            int root = Find(label);
+            auto found = openRoots.find(root);
+            if (found == openRoots.end()) {
+                int newLabel = static_cast<int>(parents.size());
+                found = openRoots.emplace(root, newLabel).first;
+                parents.push_back(newLabel);
+                components.push_back(m_components[root]);
+            }
+            label = found->second;
+        }
+        for (int label = 1; label < static_cast<int>(m_parents.size()); label++) {
+            if ((m_parents[label] == label) && (openRoots.find(label) == openRoots.end())) {
+                m_visitor(m_components[label]);
+            }
+        }
+        m_parents.swap(parents);
+        m_components.swap(components);
+    }//end FinishRow
+
+private:
+    int m_width;
+    ComponentVisitor m_visitor;
+    ///Top of the tile row being added
+    int m_rowY;
+    ///Labels of the last pixel row above the current tile row
+    std::vector<int> m_bottomRow;
+    ///Labels of the last pixel row of the current tile row, filled as its tiles are added
+    std::vector<int> m_nextBottomRow;
+    ///Labels of the last column of the previous tile in the current tile row
+    std::vector<int> m_rightColumn;
+    ///Union-find parent of each label, and the measurements of each root
+    std::vector<int> m_parents;
+    std::vector<Component> m_components;
+};//end class ComponentLabeler
+
+#endif
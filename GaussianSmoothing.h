@@ -0,0 +1,124 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_GAUSSIANSMOOTHING_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_GAUSSIANSMOOTHING_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+///Separable Gaussian blur of the per-channel optical density of an image
+//
+///The rows are blurred one at a time into a ring of 2 x radius + 1 rows, and each
+///output row is blurred down the columns as soon as the rows below it are ready,
+///so both passes work on a few rows that stay in cache. Near the edges of the
+///image the weights are renormalized over the pixels inside it, so a tile read
+///with a halo of GetRadius() pixels gives the same interior as the whole image.
+class GaussianSmoothing {
+public:
+    ///Optical density of the R, G and B channels of a pixel
+    typedef std::array<float, 3> ODPixel;
+
+public:
+    ///Constructor: the standard deviation of the Gaussian, in pixels
+    GaussianSmoothing(const double &_sigma) :
+        m_radius(0),
+        m_weights()
+    {
+        //Below a third of a pixel the neighbors' weights are negligible
+        if (_sigma < GetMinSigma()) { return; }
+        m_radius = static_cast<int>(std::ceil(3.0 * _sigma));
+        for (int k = -m_radius; k <= m_radius; k++) {
+            m_weights.push_back(static_cast<float>(std::exp(-0.5 * k * k / (_sigma * _sigma))));
+        }
+    }//end constructor
+
+    virtual ~GaussianSmoothing(void) {
+    }//end destructor
+
+    inline bool IsActive() const { return m_radius > 0; }
+    ///Width of the border around a tile needed to blur the tile exactly
+    inline int GetRadius() const { return m_radius; }
+    inline static double GetMinSigma() { return 1.0 / 3.0; }
+
+    ///Blur a row-major image of channel ODs, in place
+    void Apply(std::vector<ODPixel> &_od, const int &_width, const int &_height) const {
+        if (!IsActive() || (_width <= 0) || (_height <= 0)) { return; }
+        int ringRows = 2 * m_radius + 1;
+        std::vector<ODPixel> ring(static_cast<std::size_t>(ringRows) * _width);
+        std::vector<ODPixel> outputRow(_width);
+        //Rows of _od are overwritten once no later output row needs them,
+        //which is always true because the ring holds the blurred copies
+        int nextRow = 0;
+        for (int y = 0; y < _height; y++) {
+            //Blur along the rows up to radius rows below y
+            for (; (nextRow < _height) && (nextRow <= y + m_radius); nextRow++) {
+                BlurRow(&_od[static_cast<std::size_t>(nextRow) * _width],
+                    &ring[static_cast<std::size_t>(nextRow % ringRows) * _width], _width);
+            }
+            //Blur down the columns
+            int k0 = std::max(-m_radius, -y), k1 = std::min(m_radius, _height - 1 - y);
+            float weightSum = 0.0f;
+            for (int k = k0; k <= k1; k++) { weightSum += m_weights[k + m_radius]; }
+            for (int x = 0; x < _width; x++) { outputRow[x] = { 0.0f, 0.0f, 0.0f }; }
+            for (int k = k0; k <= k1; k++) {
+                float weight = m_weights[k + m_radius] / weightSum;
+                const ODPixel *row = &ring[static_cast<std::size_t>((y + k) % ringRows) * _width];
+                for (int x = 0; x < _width; x++) {
+                    outputRow[x][0] += weight * row[x][0];
+                    outputRow[x][1] += weight * row[x][1];
+                    outputRow[x][2] += weight * row[x][2];
+                }
+            }
+            std::copy(outputRow.begin(), outputRow.end(), _od.begin() + static_cast<std::size_t>(y) * _width);
+        }
+    }//end Apply
+
+private:
+    ///Blur one row of _width pixels from _in into _out
+    inline void BlurRow(const ODPixel *_in, ODPixel *_out, const int &_width) const {
+        for (int x = 0; x < _width; x++) {
+            int k0 = std::max(-m_radius, -x), k1 = std::min(m_radius, _width - 1 - x);
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            float weightSum = 0.0f;
+            for (int k = k0; k <= k1; k++) {
+                float weight = m_weights[k + m_radius];
+                weightSum += weight;
+                sum[0] += weight * _in[x + k][0];
+                sum[1] += weight * _in[x + k][1];
+                sum[2] += weight * _in[x + k][2];
+            }
+            _out[x] = { sum[0] / weightSum, sum[1] / weightSum, sum[2] / weightSum };
+        }
+    }//end BlurRow
+
+private:
+    int m_radius;
+    ///Unnormalized weights for offsets -m_radius to m_radius
+    std::vector<float> m_weights;
+};//end class GaussianSmoothing
+
+#endif
@@ -0,0 +1,151 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_HALOTILESTREAM_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_HALOTILESTREAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+///Assembles tiles of an image together with a halo of neighboring pixels, reading each pixel once
+//
+///Tiles must be requested in raster order: tile rows from top to bottom, and tiles
+///from left to right within a row. The halo shared with the tile to the left is
+///kept from that tile, and the halo shared with the tile row above is kept from
+///that row, so only the pixels not seen before are fetched. Memory is bounded by
+///2 x halo rows across the region plus 2 x halo columns down one tile.
+///T is the pixel type, e.g. a mask value or the channel ODs of a pixel.
+template <typename T>
+class HaloTileStream {
+public:
+    ///Fills a row-major vector with the pixels of a rectangle (x, y, width, height) of the region
+    typedef std::function<void(int, int, int, int, std::vector<T>&)> FetchFunction;
+
+public:
+    ///Constructor: size of the region, and width of the halo (at most half the tile size)
+    HaloTileStream(const int &_width, const int &_height, const int &_halo) :
+        m_width(_width),
+        m_height(_height),
+        m_halo(_halo),
+        m_rowY(-1),
+        m_seamY(0),
+        m_seamRows(0),
+        m_seam(),
+        m_nextSeamY(0),
+        m_nextSeamRows(0),
+        m_nextSeam(),
+        m_leftX(0),
+        m_leftColumns(0),
+        m_left()
+    {
+    }//end constructor
+
+    virtual ~HaloTileStream(void) {
+    }//end destructor
+
+    ///Get a tile and its halo, clipped to the region
+    //
+    ///\param _x, _y, _w, _h: the tile, relative to the region
+    ///\param _fetch: reads the pixels of the halo tile that have not been seen before
+    ///\param _expanded: set to the row-major pixels of the tile with its halo
+    ///\param _ex, _ey, _ew, _eh: set to the rectangle covered by _expanded
+    void GetTile(const int &_x, const int &_y, const int &_w, const int &_h, const FetchFunction &_fetch,
+        std::vector<T> &_expanded, int &_ex, int &_ey, int &_ew, int &_eh) {
+        if (_y != m_rowY) {
+            //A new tile row: the bottom halo of the last row is now the top halo
+            m_seam.swap(m_nextSeam);
+            m_seamY = m_nextSeamY;
+            m_seamRows = m_nextSeamRows;
+            m_nextSeamY = std::max(0, _y + _h - m_halo);
+            m_nextSeamRows = std::min(m_height, _y + _h + m_halo) - m_nextSeamY;
+            m_nextSeam.assign(static_cast<std::size_t>(m_nextSeamRows) * m_width, T());
+            m_leftColumns = 0;
+            m_rowY = _y;
+        }
+        int x0 = std::max(0, _x - m_halo), x1 = std::min(m_width, _x + _w + m_halo);
+        int y0 = std::max(0, _y - m_halo), y1 = std::min(m_height, _y + _h + m_halo);
+        _ex = x0; _ey = y0; _ew = x1 - x0; _eh = y1 - y0;
+        _expanded.assign(static_cast<std::size_t>(_ew) * _eh, T());
+
+        //Rows above y + halo were read with the tile row above
+        int seamEnd = (m_seamRows > 0) ? std::min(y1, m_seamY + m_seamRows) : y0;
+        for (int y = y0; y < seamEnd; y++) {
+            const T *src = m_seam.data() + static_cast<std::size_t>(y - m_seamY) * m_width;
+            std::copy(src + x0, src + x1, _expanded.begin() + (y - y0) * _ew);
+        }
+        //Columns left of x + halo were read with the tile to the left
+        int leftEnd = (m_leftColumns > 0) ? std::min(x1, m_leftX + m_leftColumns) : x0;
+        for (int y = seamEnd; (y < y1) && (leftEnd > x0); y++) {
+            const T *src = m_left.data() + static_cast<std::size_t>(y - seamEnd) * m_leftColumns;
+            std::copy(src + (x0 - m_leftX), src + (leftEnd - m_leftX), _expanded.begin() + (y - y0) * _ew);
+        }
+        //Everything else is new
+        if ((leftEnd < x1) && (seamEnd < y1)) {
+            std::vector<T> fetched;
+            int fw = x1 - leftEnd, fh = y1 - seamEnd;
+            _fetch(leftEnd, seamEnd, fw, fh, fetched);
+            for (int y = 0; y < fh; y++) {
+                std::copy(fetched.begin() + y * fw, fetched.begin() + (y + 1) * fw,
+                    _expanded.begin() + (seamEnd - y0 + y) * _ew + (leftEnd - x0));
+            }
+        }
+
+        //Keep the halo shared with the next tile, below the rows kept in the seam
+        m_leftX = std::max(x0, _x + _w - m_halo);
+        m_leftColumns = x1 - m_leftX;
+        m_left.resize(static_cast<std::size_t>(m_leftColumns) * std::max(0, y1 - seamEnd));
+        for (int y = seamEnd; y < y1; y++) {
+            const T *src = _expanded.data() + (y - y0) * _ew + (m_leftX - x0);
+            std::copy(src, src + m_leftColumns, m_left.begin() + (y - seamEnd) * m_leftColumns);
+        }
+        //Keep this tile's columns of the halo shared with the next tile row
+        for (int y = m_nextSeamY; y < m_nextSeamY + m_nextSeamRows; y++) {
+            const T *src = _expanded.data() + (y - y0) * _ew + (_x - x0);
+            std::copy(src, src + _w, m_nextSeam.begin() + static_cast<std::size_t>(y - m_nextSeamY) * m_width + _x);
+        }
+    }//end GetTile
+
+private:
+    int m_width;
+    int m_height;
+    int m_halo;
+    ///Top of the tile row being read
+    int m_rowY;
+    ///Rows of the region shared between the previous and current tile rows
+    int m_seamY;
+    int m_seamRows;
+    std::vector<T> m_seam;
+    ///Rows of the region shared between the current and next tile rows
+    int m_nextSeamY;
+    int m_nextSeamRows;
+    std::vector<T> m_nextSeam;
+    ///Columns shared between the previous and current tiles, below the seam rows
+    int m_leftX;
+    int m_leftColumns;
+    std::vector<T> m_left;
+};//end class HaloTileStream
+
+#endif
@@ -0,0 +1,161 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_INCREMENTALMASK_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_INCREMENTALMASK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+///An index of the pixels of each tile of a region, sorted by quantized weighted OD
+//
+///When the threshold moves, only the pixels whose quantized weighted OD lies
+///between the old and new thresholds change state. Those pixels are found by
+///binary search in each tile, so the work is proportional to the number of
+///pixels that change rather than the area of the region. The index uses six
+///bytes per pixel, so it is only kept for regions up to a size limit.
+///
+///The plugin updates its mask pyramid from it, so the zoomed-out mask display and the
+///pyramid follow a threshold change incrementally. Display tiles thresholded by the
+///kernel are still recomputed, because the kernel works on source tiles at the display
+///resolution rather than on the indexed full-resolution pixels.
+class IncrementalMask {
+public:
+    ///A range of quantized OD values [first, last)
+    typedef std::pair<int, int> KeyRange;
+
+public:
+    ///Constructor: size of the region and the width and height of its tiles
+    IncrementalMask(const int &_width, const int &_height, const int &_tileSize) :
+        m_width(_width),
+        m_tileSize(_tileSize),
+        m_tilesAcross((_width + _tileSize - 1) / _tileSize),
+        m_tilesDown((_height + _tileSize - 1) / _tileSize),
+        m_numTilesSet(0)
+    {
+        std::size_t numTiles = static_cast<std::size_t>(m_tilesAcross) * m_tilesDown;
+        m_keys.resize(numTiles);
+        m_positions.resize(numTiles);
+    }//end constructor
+
+    virtual ~IncrementalMask(void) {
+    }//end destructor
+
+    ///Quantize a weighted OD value to an index key (steps of 0.0001 OD)
+    inline static int QuantizeOD(const double &_od) {
+        double key = std::floor(_od * GetKeysPerOD() + 1e-6);
+        return static_cast<int>(std::min(std::max(key, 0.0), static_cast<double>(GetMaxKey())));
+    }//end QuantizeOD
+
+    ///Range of keys retained at a threshold: at or above it, or at or below it
+    inline static KeyRange GetRetainedRange(const double &_threshold, const bool &_retainHigher) {
+        int thresholdKey = static_cast<int>(std::round(_threshold * GetKeysPerOD()));
+        thresholdKey = std::min(std::max(thresholdKey, 0), GetMaxKey());
+        return _retainHigher ? KeyRange(thresholdKey, GetMaxKey() + 1) : KeyRange(0, thresholdKey + 1);
+    }//end GetRetainedRange
+
+    inline static double GetKeysPerOD() { return 10000.0; }
+    inline static int GetMaxKey() { return 65535; }
+
+    ///Store the keys of the pixels of a tile (row-major) at its position relative to the region
+    void SetTile(const int &_x, const int &_y, const int &_width, const int &_height,
+        const std::vector<std::uint16_t> &_keys) {
+        std::size_t tile = GetTileIndex(_x / m_tileSize, _y / m_tileSize);
+        //Keys past the tile (e.g. of a larger reused buffer) are ignored
+        std::size_t numPixels = std::min(_keys.size(), static_cast<std::size_t>(_width) * _height);
+        //Sort the pixels by key, packing the key above the position within the tile
+        std::vector<std::uint64_t> packed(numPixels);
+        for (std::size_t px = 0; px < numPixels; px++) {
+            packed[px] = (static_cast<std::uint64_t>(_keys[px]) << 32) | px;
+        }
+        std::sort(packed.begin(), packed.end());
+        std::vector<std::uint16_t> &keys = m_keys[tile];
+        std::vector<std::uint32_t> &positions = m_positions[tile];
+        keys.resize(packed.size());
+        positions.resize(packed.size());
+        for (std::size_t i = 0; i < packed.size(); i++) {
+            keys[i] = static_cast<std::uint16_t>(packed[i] >> 32);
+            //Store positions relative to the region
+            std::uint32_t px = static_cast<std::uint32_t>(packed[i] & 0xFFFFFFFF);
+            positions[i] = static_cast<std::uint32_t>(_y + px / _width) * m_width + (_x + px % _width);
+        }
+        m_numTilesSet++;
+    }//end SetTile
+
+    ///Check whether every tile of the region has been stored
+    inline bool IsComplete() const {
+        return m_numTilesSet == static_cast<std::size_t>(m_tilesAcross) * m_tilesDown;
+    }//end IsComplete
+
+    ///Visit the position (relative to the region) of every pixel with a key in the range
+    void ForEachPixelInRange(const KeyRange &_range, 
+        const std::function<void(int, int)> &_visitor) const {
+        if (_range.first >= _range.second) { return; }
+        for (std::size_t tile = 0; tile < m_keys.size(); tile++) {
+            const std::vector<std::uint16_t> &keys = m_keys[tile];
+            auto first = std::lower_bound(keys.begin(), keys.end(), _range.first);
+            auto last = std::lower_bound(first, keys.end(), _range.second);
+            for (auto k = first; k != last; ++k) {
+                std::uint32_t position = m_positions[tile][k - keys.begin()];
+                _visitor(static_cast<int>(position % m_width), static_cast<int>(position / m_width));
+            }
+        }
+    }//end ForEachPixelInRange
+
+    ///Visit the pixels whose state differs between two retained key ranges
+    //
+    ///\param _visitor receives the pixel position, and +1 if it becomes retained or -1 if it is no longer retained
+    void ForEachChangedPixel(const KeyRange &_old, const KeyRange &_new,
+        const std::function<void(int, int, int)> &_visitor) const {
+        //Pixels leaving the retained range: _old minus _new
+        auto removed = [&](int x, int y) { _visitor(x, y, -1); };
+        ForEachPixelInRange(KeyRange(_old.first, std::min(_old.second, _new.first)), removed);
+        ForEachPixelInRange(KeyRange(std::max(_old.first, _new.second), _old.second), removed);
+        //Pixels entering the retained range: _new minus _old
+        auto added = [&](int x, int y) { _visitor(x, y, 1); };
+        ForEachPixelInRange(KeyRange(_new.first, std::min(_new.second, _old.first)), added);
+        ForEachPixelInRange(KeyRange(std::max(_new.first, _old.second), _new.second), added);
+    }//end ForEachChangedPixel
+
+private:
+    inline std::size_t GetTileIndex(const int &_column, const int &_row) const {
+        return static_cast<std::size_t>(_row) * m_tilesAcross + _column;
+    }//end GetTileIndex
+
+private:
+    int m_width;
+    int m_tileSize;
+    int m_tilesAcross;
+    int m_tilesDown;
+    std::size_t m_numTilesSet;
+    ///Sorted keys of each tile
+    std::vector<std::vector<std::uint16_t>> m_keys;
+    ///Positions relative to the region, in the same order as m_keys
+    std::vector<std::vector<std::uint32_t>> m_positions;
+};
+
+#endif
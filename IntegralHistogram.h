@@ -0,0 +1,117 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_INTEGRALHISTOGRAM_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_INTEGRALHISTOGRAM_H
+
+#include "ODHistogram.h"
+
+#include <cstdint>
+#include <vector>
+
+///A summed-area table of weighted OD histograms over a grid of cells
+//
+///Each cell's histogram is stored cumulatively (the count of values in each bin
+///or above), then summed over all cells above and to the left. The number of
+///values at or above any bin, within any rectangle of whole cells, is then four
+///table lookups.
+class IntegralHistogram {
+public:
+    ///Constructor: the grid size and the bins of the cell histograms
+    IntegralHistogram(const int &_cellsAcross, const int &_cellsDown, 
+        const double &_maxOD, const int &_numBins) :
+        m_cellsAcross(_cellsAcross),
+        m_cellsDown(_cellsDown),
+        m_binning(_maxOD, _numBins),
+        m_table(static_cast<std::size_t>(_cellsAcross + 1) * (_cellsDown + 1) * (_numBins + 1), 0)
+    {}//end constructor
+
+    virtual ~IntegralHistogram(void) {
+    }//end destructor
+
+    ///Store the histogram of one cell. It must have the same bins as this table.
+    void SetCell(const int &_column, const int &_row, const ODHistogram &_histogram) {
+        //Cells are stored one row and column in, leaving the top and left border as zero
+        std::int64_t *entry = GetEntry(_column + 1, _row + 1);
+        std::int64_t atOrAbove = 0;
+        for (int bin = GetNumBins(); bin >= 0; bin--) {
+            atOrAbove += _histogram.GetCount(bin);
+            entry[bin] = atOrAbove;
+        }
+    }//end SetCell
+
+    ///Sum the cells into the summed-area table, once all cells have been set
+    void Build() {
+        int numBins = GetNumBins();
+        for (int r = 1; r <= m_cellsDown; r++) {
+            for (int c = 1; c <= m_cellsAcross; c++) {
+                std::int64_t *entry = GetEntry(c, r);
+                const std::int64_t *left = GetEntry(c - 1, r);
+                const std::int64_t *above = GetEntry(c, r - 1);
+                const std::int64_t *aboveLeft = GetEntry(c - 1, r - 1);
+                for (int bin = 0; bin <= numBins; bin++) {
+                    entry[bin] += left[bin] + above[bin] - aboveLeft[bin];
+                }
+            }
+        }
+    }//end Build
+
+    ///Number of values at or above a bin within the cells [_c0, _c1) x [_r0, _r1)
+    inline std::int64_t GetCountAtOrAbove(const int &_c0, const int &_r0,
+        const int &_c1, const int &_r1, const int &_bin) const {
+        return GetEntry(_c1, _r1)[_bin] - GetEntry(_c0, _r1)[_bin]
+            - GetEntry(_c1, _r0)[_bin] + GetEntry(_c0, _r0)[_bin];
+    }//end GetCountAtOrAbove
+
+    ///Number of values within the cells [_c0, _c1) x [_r0, _r1)
+    inline std::int64_t GetCount(const int &_c0, const int &_r0,
+        const int &_c1, const int &_r1) const {
+        return GetCountAtOrAbove(_c0, _r0, _c1, _r1, 0);
+    }//end GetCount
+
+    ///Bin that an OD value falls into
+    inline int GetBinIndex(const double &_od) const { return m_binning.GetBinIndex(_od); }
+    ///Number of regular bins (excluding the overflow bin)
+    inline int GetNumBins() const { return m_binning.GetNumBins(); }
+    inline int GetCellsAcross() const { return m_cellsAcross; }
+    inline int GetCellsDown() const { return m_cellsDown; }
+
+private:
+    inline std::int64_t* GetEntry(const int &_c, const int &_r) {
+        return m_table.data() + (static_cast<std::size_t>(_r) * (m_cellsAcross + 1) + _c) * (GetNumBins() + 1);
+    }//end GetEntry
+    inline const std::int64_t* GetEntry(const int &_c, const int &_r) const {
+        return m_table.data() + (static_cast<std::size_t>(_r) * (m_cellsAcross + 1) + _c) * (GetNumBins() + 1);
+    }//end GetEntry
+
+private:
+    int m_cellsAcross;
+    int m_cellsDown;
+    ///An empty histogram, used only for its bin definitions
+    ODHistogram m_binning;
+    ///Cumulative counts per bin, summed over cells, with a zero top row and left column
+    std::vector<std::int64_t> m_table;
+};
+
+#endif
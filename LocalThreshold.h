@@ -0,0 +1,120 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_LOCALTHRESHOLD_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_LOCALTHRESHOLD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+///Adaptive thresholding of weighted OD by the mean and standard deviation of a local window
+//
+///The sum and sum of squares of each window are read from integral images in four
+///lookups, so the cost per pixel does not depend on the window size. Windows are
+///clipped to the image, so a tile read with a halo of GetRadius() pixels gives the
+///same result in its interior as the whole image.
+class LocalThreshold {
+public:
+    ///Methods, in the order of the plugin's option list
+    enum Method {
+        NONE,
+        ///Threshold is mean + k * std
+        NIBLACK,
+        ///Threshold is mean * (1 + k * (std / R - 1)), which stays near the mean in flat areas
+        SAUVOLA
+    };
+
+public:
+    ///Constructor: the method, the window radius, k, and the dynamic range R of the standard deviation (Sauvola)
+    LocalThreshold(const Method &_method, const int &_radius, const double &_k, const double &_range = 0.5) :
+        m_method(_method),
+        m_radius(std::max(0, _radius)),
+        m_k(_k),
+        m_range((_range > 0.0) ? _range : 1.0)
+    {
+    }//end constructor
+
+    virtual ~LocalThreshold(void) {
+    }//end destructor
+
+    inline bool IsActive() const { return (NONE != m_method) && (m_radius > 0); }
+    ///Width of the border around a tile needed to threshold the tile exactly
+    inline int GetRadius() const { return IsActive() ? m_radius : 0; }
+
+    ///Threshold from the mean and standard deviation of a window
+    inline double GetThreshold(const double &_mean, const double &_std) const {
+        if (SAUVOLA == m_method) {
+            return _mean * (1.0 + m_k * (_std / m_range - 1.0));
+        }
+        return _mean + m_k * _std;
+    }//end GetThreshold
+
+    ///Set _mask to 1 where the row-major weighted OD image passes its local threshold, 0 elsewhere
+    //
+    ///As with the global threshold, a value equal to the threshold is retained by either behavior.
+    void Apply(const std::vector<float> &_wod, const int &_width, const int &_height,
+        const bool &_retainHigher, std::vector<std::uint8_t> &_mask) const {
+        _mask.assign(_wod.size(), 0);
+        if (!IsActive() || (_width <= 0) || (_height <= 0)) { return; }
+        //Integral images of the values and their squares, with a row and column of zeros
+        int stride = _width + 1;
+        std::vector<double> sums(static_cast<std::size_t>(stride) * (_height + 1), 0.0);
+        std::vector<double> squares(sums.size(), 0.0);
+        for (int y = 0; y < _height; y++) {
+            double rowSum = 0.0, rowSquares = 0.0;
+            for (int x = 0; x < _width; x++) {
+                double v = _wod[static_cast<std::size_t>(y) * _width + x];
+                rowSum += v;
+                rowSquares += v * v;
+                std::size_t i = static_cast<std::size_t>(y + 1) * stride + x + 1;
+                sums[i] = sums[i - stride] + rowSum;
+                squares[i] = squares[i - stride] + rowSquares;
+            }
+        }
+        for (int y = 0; y < _height; y++) {
+            int y0 = std::max(0, y - m_radius), y1 = std::min(_height, y + m_radius + 1);
+            for (int x = 0; x < _width; x++) {
+                int x0 = std::max(0, x - m_radius), x1 = std::min(_width, x + m_radius + 1);
+                std::size_t a = static_cast<std::size_t>(y0) * stride + x0, b = static_cast<std::size_t>(y0) * stride + x1;
+                std::size_t c = static_cast<std::size_t>(y1) * stride + x0, d = static_cast<std::size_t>(y1) * stride + x1;
+                double n = static_cast<double>((x1 - x0) * (y1 - y0));
+                double mean = (sums[d] - sums[b] - sums[c] + sums[a]) / n;
+                double variance = (squares[d] - squares[b] - squares[c] + squares[a]) / n - mean * mean;
+                double threshold = GetThreshold(mean, std::sqrt(std::max(0.0, variance)));
+                double v = _wod[static_cast<std::size_t>(y) * _width + x];
+                _mask[static_cast<std::size_t>(y) * _width + x] = (_retainHigher ? (v >= threshold) : (v <= threshold)) ? 1 : 0;
+            }
+        }
+    }//end Apply
+
+private:
+    Method m_method;
+    int m_radius;
+    double m_k;
+    double m_range;
+};//end class LocalThreshold
+
+#endif
@@ -0,0 +1,182 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_MASKMORPHOLOGY_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_MASKMORPHOLOGY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+///Binary erosion, dilation, opening and closing of a mask with a square structuring element
+//
+///The mask is packed 64 pixels to a word, so each step of the structuring element
+///is a shift and an AND (erosion) or OR (dilation) over 64 pixels at once. The square
+///is separable, so a radius r costs 2r word operations per word in each direction.
+///Pixels outside the mask do not affect the result (they count as foreground for
+///erosion and background for dilation), so a tile that includes a halo of GetHalo()
+///pixels on each side gives the same result in its interior as the whole image.
+class MaskMorphology {
+public:
+    ///Operations, in the order of the plugin's option list
+    enum Operation {
+        NONE,
+        ERODE,
+        DILATE,
+        ///Erosion followed by dilation: removes specks smaller than the structuring element
+        OPEN,
+        ///Dilation followed by erosion: fills holes and gaps smaller than the structuring element
+        CLOSE
+    };
+
+public:
+    ///Constructor: the operation, and the radius of the square structuring element
+    MaskMorphology(const Operation &_operation, const int &_radius) :
+        m_operation(_operation),
+        m_radius(std::max(0, _radius))
+    {
+    }//end constructor
+
+    virtual ~MaskMorphology(void) {
+    }//end destructor
+
+    inline bool IsActive() const { return (NONE != m_operation) && (m_radius > 0); }
+
+    ///Width of the border around a tile needed to compute the tile exactly
+    inline int GetHalo() const {
+        if (!IsActive()) { return 0; }
+        return ((OPEN == m_operation) || (CLOSE == m_operation)) ? 2 * m_radius : m_radius;
+    }//end GetHalo
+
+    ///Apply the operation to a row-major mask (nonzero is foreground), in place
+    void Apply(std::vector<std::uint8_t> &_mask, const int &_width, const int &_height) const {
+        if (!IsActive() || (_width <= 0) || (_height <= 0)) { return; }
+        int wordsPerRow = (_width + 63) / 64;
+        std::vector<std::uint64_t> packed(static_cast<std::size_t>(wordsPerRow) * _height, 0);
+        for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+                if (0 != _mask[y*_width + x]) {
+                    packed[y*wordsPerRow + x / 64] |= std::uint64_t(1) << (x % 64);
+                }
+            }
+        }
+        switch (m_operation) {
+        case ERODE:
+            Pass(packed, _width, _height, true);
+            break;
+        case DILATE:
+            Pass(packed, _width, _height, false);
+            break;
+        case OPEN:
+            Pass(packed, _width, _height, true);
+            Pass(packed, _width, _height, false);
+            break;
+        case CLOSE:
+            Pass(packed, _width, _height, false);
+            Pass(packed, _width, _height, true);
+            break;
+        default:
+            break;
+        }
+        for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+                _mask[y*_width + x] = static_cast<std::uint8_t>((packed[y*wordsPerRow + x / 64] >> (x % 64)) & 1);
+            }
+        }
+    }//end Apply
+
+private:
+    ///One erosion or dilation: along the rows, then down the columns
+    void Pass(std::vector<std::uint64_t> &_packed, const int &_width, const int &_height,
+        const bool &_erode) const {
+        int wordsPerRow = (_width + 63) / 64;
+        //Bits beyond the right edge take the neutral value, as if outside the mask
+        std::uint64_t lastWordMask = (0 == _width % 64) ? ~std::uint64_t(0)
+            : ((std::uint64_t(1) << (_width % 64)) - 1);
+        std::vector<std::uint64_t> row(wordsPerRow), result(wordsPerRow);
+        for (int y = 0; y < _height; y++) {
+            std::uint64_t *words = _packed.data() + static_cast<std::size_t>(y) * wordsPerRow;
+            std::copy(words, words + wordsPerRow, row.begin());
+            if (_erode) {
+                row[wordsPerRow - 1] |= ~lastWordMask;
+            }
+            std::copy(row.begin(), row.end(), result.begin());
+            for (int s = 1; s <= m_radius; s++) {
+                for (int w = 0; w < wordsPerRow; w++) {
+                    std::uint64_t fromLeft = ShiftedFromLeft(row, w, s, _erode);
+                    std::uint64_t fromRight = ShiftedFromRight(row, w, s, _erode);
+                    result[w] = _erode ? (result[w] & fromLeft & fromRight) : (result[w] | fromLeft | fromRight);
+                }
+            }
+            result[wordsPerRow - 1] &= lastWordMask;
+            std::copy(result.begin(), result.end(), words);
+        }
+
+        //Rows outside the mask are skipped, which is the neutral value
+        std::vector<std::uint64_t> source(_packed);
+        for (int y = 0; y < _height; y++) {
+            int y0 = std::max(0, y - m_radius), y1 = std::min(_height - 1, y + m_radius);
+            std::uint64_t *words = _packed.data() + static_cast<std::size_t>(y) * wordsPerRow;
+            for (int yy = y0; yy <= y1; yy++) {
+                const std::uint64_t *other = source.data() + static_cast<std::size_t>(yy) * wordsPerRow;
+                for (int w = 0; w < wordsPerRow; w++) {
+                    words[w] = _erode ? (words[w] & other[w]) : (words[w] | other[w]);
+                }
+            }
+        }
+    }//end Pass
+
+    ///Word w of the row moved s pixels to the right (each pixel sees its neighbor s to the left)
+    inline static std::uint64_t ShiftedFromLeft(const std::vector<std::uint64_t> &_row,
+        const int &_w, const int &_s, const bool &_fill) {
+        int wordShift = _s / 64, bitShift = _s % 64;
+        auto word = [&](int i) -> std::uint64_t {
+            return (i < 0) ? (_fill ? ~std::uint64_t(0) : 0) : _row[i];
+        };
+        std::uint64_t hi = word(_w - wordShift);
+        if (0 == bitShift) { return hi; }
+        std::uint64_t lo = word(_w - wordShift - 1);
+        return (hi << bitShift) | (lo >> (64 - bitShift));
+    }//end ShiftedFromLeft
+
+    ///Word w of the row moved s pixels to the left (each pixel sees its neighbor s to the right)
+    inline static std::uint64_t ShiftedFromRight(const std::vector<std::uint64_t> &_row,
+        const int &_w, const int &_s, const bool &_fill) {
+        int wordShift = _s / 64, bitShift = _s % 64;
+        int numWords = static_cast<int>(_row.size());
+        auto word = [&](int i) -> std::uint64_t {
+            return (i >= numWords) ? (_fill ? ~std::uint64_t(0) : 0) : _row[i];
+        };
+        std::uint64_t lo = word(_w + wordShift);
+        if (0 == bitShift) { return lo; }
+        std::uint64_t hi = word(_w + wordShift + 1);
+        return (lo >> bitShift) | (hi << (64 - bitShift));
+    }//end ShiftedFromRight
+
+private:
+    Operation m_operation;
+    int m_radius;
+};//end class MaskMorphology
+
+#endif
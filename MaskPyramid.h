@@ -0,0 +1,186 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_MASKPYRAMID_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_MASKPYRAMID_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+///A resolution pyramid of a binary mask, reduced from the full-resolution mask
+//
+///Each cell of a level counts the full-resolution pixels retained within it.
+///The finest stored level is the coarsest power of two downsampling of the
+///full-resolution mask that fits within the maximum number of cells, so
+///memory use does not grow with the size of the region. A cell of the finest stored
+///level covers far fewer than 2^32 pixels, so its counts are 32-bit; the coarser levels
+///are 64-bit, as a cell of them can cover more of a large slide.
+class MaskPyramid {
+public:
+    ///How a cell of a reduced level is converted to a mask value
+    enum Reduction {
+        ///Fraction of the full-resolution pixels in the cell that are retained
+        COVERAGE,
+        ///Retained if at least half of the full-resolution pixels in the cell are retained
+        MAJORITY
+    };
+
+public:
+    ///Constructor: size of the full-resolution mask, and the maximum number of cells in the finest stored level
+    MaskPyramid(const int &_width, const int &_height, const int &_maxCells) :
+        m_width(_width),
+        m_height(_height),
+        m_baseShift(0)
+    {
+        //Find the smallest power of two downsampling that fits in _maxCells
+        while ((static_cast<long long>(CellsAlong(m_width, m_baseShift))
+            * CellsAlong(m_height, m_baseShift) > _maxCells)
+            && ((1 << m_baseShift) < std::max(m_width, m_height))) {
+            m_baseShift++;
+        }
+        m_baseCounts.assign(static_cast<std::size_t>(
+            CellsAlong(m_width, m_baseShift)) * CellsAlong(m_height, m_baseShift), 0);
+    }//end constructor
+
+    virtual ~MaskPyramid(void) {
+    }//end destructor
+
+    ///Add a tile of the full-resolution mask (row-major, nonzero if retained) with its position in the mask
+    void AddTile(const int &_x, const int &_y, const int &_width, const int &_height,
+        const std::vector<std::uint8_t> &_mask) {
+        std::vector<std::uint32_t> &base = m_baseCounts;
+        int baseWidth = CellsAlong(m_width, m_baseShift);
+        for (int y = 0; y < _height; y++) {
+            std::size_t rowOffset = static_cast<std::size_t>((_y + y) >> m_baseShift) * baseWidth;
+            const std::uint8_t *maskRow = _mask.data() + static_cast<std::size_t>(y) * _width;
+            for (int x = 0; x < _width; x++) {
+                if (maskRow[x]) {
+                    base[rowOffset + ((_x + x) >> m_baseShift)]++;
+                }
+            }
+        }
+    }//end AddTile
+
+    ///Add a tile of the full-resolution mask in which every pixel has the same value
+    void AddUniformTile(const int &_x, const int &_y, const int &_width, const int &_height,
+        const bool &_retained) {
+        if (!_retained) { return; }
+        std::vector<std::uint32_t> &base = m_baseCounts;
+        int baseWidth = CellsAlong(m_width, m_baseShift);
+        int cellSize = 1 << m_baseShift;
+        for (int cy = (_y >> m_baseShift); cy <= ((_y + _height - 1) >> m_baseShift); cy++) {
+            int rows = std::min(_y + _height, (cy + 1) * cellSize) - std::max(_y, cy * cellSize);
+            for (int cx = (_x >> m_baseShift); cx <= ((_x + _width - 1) >> m_baseShift); cx++) {
+                int cols = std::min(_x + _width, (cx + 1) * cellSize) - std::max(_x, cx * cellSize);
+                base[static_cast<std::size_t>(cy) * baseWidth + cx] += rows * cols;
+            }
+        }
+    }//end AddUniformTile
+
+    ///Add or remove one retained full-resolution pixel; call Build() again afterwards
+    inline void AddPixel(const int &_x, const int &_y, const int &_delta) {
+        std::size_t cell = static_cast<std::size_t>(_y >> m_baseShift) 
+            * CellsAlong(m_width, m_baseShift) + (_x >> m_baseShift);
+        m_baseCounts[cell] += _delta;
+    }//end AddPixel
+
+    ///Reduce the finest stored level into coarser levels, down to a single cell
+    void Build() {
+        m_coarserCounts.clear();
+        while ((GetLevelWidth(GetNumLevels() - 1) > 1) || (GetLevelHeight(GetNumLevels() - 1) > 1)) {
+            int finer = GetNumLevels() - 1;
+            int finerWidth = GetLevelWidth(finer), finerHeight = GetLevelHeight(finer);
+            int shift = m_baseShift + finer + 1;
+            int width = CellsAlong(m_width, shift), height = CellsAlong(m_height, shift);
+            std::vector<std::uint64_t> counts(static_cast<std::size_t>(width) * height, 0);
+            for (int y = 0; y < finerHeight; y++) {
+                for (int x = 0; x < finerWidth; x++) {
+                    counts[static_cast<std::size_t>(y / 2) * width + x / 2] 
+                        += GetCount(finer, static_cast<std::size_t>(y) * finerWidth + x);
+                }
+            }
+            m_coarserCounts.push_back(std::move(counts));
+        }
+    }//end Build
+
+    ///Number of stored levels
+    inline int GetNumLevels() const { return 1 + static_cast<int>(m_coarserCounts.size()); }
+    ///Downsampling factor of a level relative to the full-resolution mask
+    inline int GetLevelFactor(const int &_level) const { return 1 << (m_baseShift + _level); }
+    inline int GetLevelWidth(const int &_level) const { return CellsAlong(m_width, m_baseShift + _level); }
+    inline int GetLevelHeight(const int &_level) const { return CellsAlong(m_height, m_baseShift + _level); }
+
+    ///Choose the finest level whose factor does not exceed the downsampling; -1 if all are coarser
+    int SelectLevel(const double &_downsample) const {
+        int level = -1;
+        for (int l = 0; l < GetNumLevels(); l++) {
+            if (GetLevelFactor(l) <= _downsample) { level = l; }
+        }
+        return level;
+    }//end SelectLevel
+
+    ///Fraction of the full-resolution pixels within a cell that are retained
+    inline double GetCoverage(const int &_level, const int &_cx, const int &_cy) const {
+        int factor = GetLevelFactor(_level);
+        int cellWidth = std::min(factor, m_width - _cx * factor);
+        int cellHeight = std::min(factor, m_height - _cy * factor);
+        double count = static_cast<double>(GetCount(_level,
+            static_cast<std::size_t>(_cy) * GetLevelWidth(_level) + _cx));
+        return count / (static_cast<double>(cellWidth) * cellHeight);
+    }//end GetCoverage
+
+    ///Mask value of a cell (0.0 to 1.0) using the given reduction
+    inline double GetValue(const int &_level, const int &_cx, const int &_cy, 
+        const Reduction &_reduction) const {
+        double coverage = GetCoverage(_level, _cx, _cy);
+        if (_reduction == MAJORITY) {
+            return (coverage >= 0.5) ? 1.0 : 0.0;
+        }
+        return coverage;
+    }//end GetValue
+
+private:
+    ///Retained pixel count of a cell (row-major index) of a level
+    inline std::uint64_t GetCount(const int &_level, const std::size_t &_cell) const {
+        return (0 == _level) ? m_baseCounts.at(_cell) : m_coarserCounts.at(_level - 1).at(_cell);
+    }//end GetCount
+
+    ///Number of cells needed to cover a length at a power of two downsampling
+    inline static int CellsAlong(const int &_length, const int &_shift) {
+        return (_length + (1 << _shift) - 1) >> _shift;
+    }//end CellsAlong
+
+private:
+    int m_width;
+    int m_height;
+    ///Downsampling of the finest stored level, as a power of two
+    int m_baseShift;
+    ///Retained pixel counts per cell of the finest stored level
+    std::vector<std::uint32_t> m_baseCounts;
+    ///Retained pixel counts per cell of the coarser levels, finest first
+    std::vector<std::vector<std::uint64_t>> m_coarserCounts;
+};
+
+#endif
@@ -25,26 +25,84 @@
 #ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODCONVERSION_H
 #define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODCONVERSION_H
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <stdexcept>
 #include <vector>
 
 ///A class with static methods or lookup-table conversion to/from optical density
+//
+///The optical density of a channel is relative to its white point (I0), the value of
+///background glass. By default every channel's white point is GetRGBMaxValue(); a
+///per-channel white point can be given, e.g. one estimated from the slide background.
+///
+///Optical density is defined on linear intensities, but scanners usually store
+///gamma-encoded values. A linearization curve per channel (such as the tone curves
+///of an ICC profile) can be folded into the per-channel lookup tables, so that a
+///linearized OD costs the same single lookup as before.
 class ODConversion {
+public:
+    ///Linear intensity (0 to 1) of each encoded value from 0 to GetRGBMaxValue(); empty for linear data
+    typedef std::vector<double> Curve;
+
 public:
     ///Constructor to build the lookup table
-    ODConversion() {
+    ODConversion() : ODConversion(GetDefaultWhitePoint()) {
+    }//end lookup table constructor
+
+    ///Constructor to build the lookup tables of each channel relative to its own white point,
+    ///after linearizing the channel values and the white point with a curve per channel
+    explicit ODConversion(const std::array<double, 3> &_whitePoint, 
+        const std::array<Curve, 3> &_curves = std::array<Curve, 3>()) :
+        m_whitePoint(_whitePoint),
+        m_curves(_curves)
+    {
         //Build the lookup table
-        m_convLookup.reserve(GetRGBMaxValue());
-        for (int i = 0; i < GetRGBMaxValue(); i++) {
+        //Include GetRGBMaxValue() itself, so that white pixels are not looked up the slow way
+        m_convLookup.reserve(GetRGBMaxValue() + 1);
+        for (int i = 0; i <= GetRGBMaxValue(); i++) {
             m_convLookup.push_back(ConvertRGBtoOD(static_cast<double>(i)));
         }
-    }//end lookup table constructor
+        for (int ch = 0; ch < 3; ch++) {
+            m_channelLookup[ch].reserve(GetRGBMaxValue() + 1);
+            double white = Linearize(ch, m_whitePoint[ch]);
+            for (int i = 0; i <= GetRGBMaxValue(); i++) {
+                m_channelLookup[ch].push_back(ConvertRGBtoOD(Linearize(ch, static_cast<double>(i)), white));
+            }
+        }
+    }//end white point constructor
 
     virtual ~ODConversion(void) {
         m_convLookup.clear();
         m_convLookup.shrink_to_fit();
     }//end destructor
 
+    ///The white point (I0) of each channel
+    inline const std::array<double, 3>& GetWhitePoint() const { return m_whitePoint; }
+
+    ///Conversions with the same white point and curves have the same tables
+    inline bool operator==(const ODConversion &_other) const {
+        return (m_whitePoint == _other.m_whitePoint) && (m_curves == _other.m_curves);
+    }
+    inline bool operator!=(const ODConversion &_other) const { return !(*this == _other); }
+
+    ///Linearize an encoded value of a channel, on the same 0 to GetRGBMaxValue() scale
+    //
+    ///Values between table entries are interpolated. Values outside the curve (e.g. of
+    ///16-bit images) and channels without a curve are not changed.
+    inline const double Linearize(const int &_channel, const double &_color) const {
+        const Curve &curve = m_curves[_channel];
+        int last = static_cast<int>(curve.size()) - 1;
+        if ((last < 1) || (_color < 0.0) || (_color > static_cast<double>(last))) {
+            return _color;
+        }
+        int i = static_cast<int>(_color);
+        i = (i >= last) ? last - 1 : i;
+        double t = _color - i;
+        return ((1.0 - t) * curve[i] + t * curve[i + 1]) * GetRGBMaxValue();
+    }//end Linearize
+
     ///RGB to OD conversion using a lookup table
     inline const double LookupRGBtoOD(const int &_color) const {
         //Using 'at' instead of operator[] means an out_of_range exception can be thrown
@@ -56,25 +114,56 @@ public:
         }
     }//end LookupRGBToOD
 
+    ///RGB to OD conversion of one channel (0 to 2), relative to that channel's white point, using a lookup table
+    inline const double LookupRGBtoOD(const int &_color, const int &_channel) const {
+        if ((_color >= 0) && (_color < static_cast<int>(m_channelLookup[_channel].size()))) {
+            return m_channelLookup[_channel][_color];
+        }
+        return ConvertRGBtoOD(Linearize(_channel, static_cast<double>(_color)), 
+            Linearize(_channel, m_whitePoint[_channel]));
+    }//end LookupRGBToOD
+
     ///OD to RGB conversion using a lookup table (in reverse)
     inline const int LookupODtoRGB(const double &_OD) const {
         //Traverse the vector in reverse, find index at which _OD is smaller than stored value
         for (auto p = m_convLookup.rbegin(); p != m_convLookup.rend(); ++p) {
             if (_OD <= *p) {
-                return static_cast<int>(m_convLookup.rend() - p);
+                int color = static_cast<int>(m_convLookup.rend() - p);
+                return (color > GetRGBMaxValue()) ? GetRGBMaxValue() : color;
             }
         }
         //if not found
         return static_cast<int>(ConvertODtoRGB(_OD));
     }//end LookupODToRGB
 
+    ///OD to RGB conversion of one channel (0 to 2), the inverse of LookupRGBtoOD(_color, _channel)
+    inline const int LookupODtoRGB(const double &_OD, const int &_channel) const {
+        //The table decreases with the color, so find the first color with OD at or below _OD
+        const std::vector<double> &table = m_channelLookup[_channel];
+        auto p = std::lower_bound(table.begin(), table.end(), _OD, 
+            [](const double &tableOD, const double &od) { return tableOD > od; });
+        if (p == table.end()) {
+            return GetRGBMaxValue();
+        }
+        //Choose the nearer of the two neighboring colors
+        if ((p != table.begin()) && (std::abs(*(p - 1) - _OD) < std::abs(*p - _OD))) {
+            --p;
+        }
+        return static_cast<int>(p - table.begin());
+    }//end LookupODToRGB
+
     ///Convert from color space (0 to 255 RGB value) to optical density
     inline static const double ConvertRGBtoOD(const double &_color) {
-        double scaleMax = static_cast<double>(GetRGBMaxValue());
+        return ConvertRGBtoOD(_color, static_cast<double>(GetRGBMaxValue()));
+    }//end ConvertRGBtoOD
+
+    ///Convert from color space (0 to 255 RGB value) to optical density, relative to a white point
+    inline static const double ConvertRGBtoOD(const double &_color, const double &_white) {
+        double scaleMax = (_white <= 0.0) ? static_cast<double>(GetRGBMaxValue()) : _white;
         //Avoid trying to calculate log(0)
         double color = (_color <= 0.0) ? GetODMinValue() : _color;
         double OD = -std::log10(color / scaleMax);
-        //Push negative values up to 0
+        //Push negative values up to 0, including values brighter than the white point
         OD = (OD < 0.0) ? 0.0 : OD;
         return OD;
     }//end ConvertRGBtoOD
@@ -96,10 +185,40 @@ public:
     inline static const double GetODMinValue() { return 1e-6; }
     ///Define the maximum value of the RGB scale used in images
     inline static const int GetRGBMaxValue() { return 255; }
+    ///The sRGB transfer curve (IEC 61966-2-1), decoded to linear intensity
+    static Curve SRGBCurve() {
+        Curve curve(GetRGBMaxValue() + 1);
+        for (int i = 0; i <= GetRGBMaxValue(); i++) {
+            double v = static_cast<double>(i) / GetRGBMaxValue();
+            curve[i] = (v <= 0.04045) ? (v / 12.92) : std::pow((v + 0.055) / 1.055, 2.4);
+        }
+        return curve;
+    }//end SRGBCurve
+
+    ///A pure power-law curve, as in the tone curves of simple ICC profiles
+    static Curve GammaCurve(const double &_gamma) {
+        Curve curve(GetRGBMaxValue() + 1);
+        for (int i = 0; i <= GetRGBMaxValue(); i++) {
+            curve[i] = std::pow(static_cast<double>(i) / GetRGBMaxValue(), _gamma);
+        }
+        return curve;
+    }//end GammaCurve
+
+    ///The white point of every channel when none is given
+    inline static const std::array<double, 3> GetDefaultWhitePoint() {
+        double scaleMax = static_cast<double>(GetRGBMaxValue());
+        return { scaleMax, scaleMax, scaleMax };
+    }
 
 private:
     ///A lookup table implemented using a vector (relies on RGB values being integers)
     std::vector<double> m_convLookup;
+    ///White point (I0) of each channel
+    std::array<double, 3> m_whitePoint;
+    ///Linearization curve of each channel
+    std::array<Curve, 3> m_curves;
+    ///A lookup table per channel, linearized and relative to that channel's white point
+    std::array<std::vector<double>, 3> m_channelLookup;
     
 };
 
@@ -0,0 +1,189 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODHISTOGRAM_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODHISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+///A histogram of weighted optical density, with the summed OD of the pixels in each bin
+//
+///Bins have equal width from 0 to a maximum OD; values at or above the maximum
+///are collected in one extra overflow bin. The number of pixels retained, and
+///their integrated OD, can then be read for any threshold without revisiting the pixels.
+class ODHistogram {
+public:
+    ///Constructor: the maximum OD of the regular bins and the number of regular bins
+    ODHistogram(const double &_maxOD, const int &_numBins) :
+        m_maxOD(_maxOD),
+        m_numBins(_numBins),
+        m_counts(_numBins + 1, 0),
+        m_ODSums(_numBins + 1, 0.0)
+    {}//end constructor
+
+    virtual ~ODHistogram(void) {
+    }//end destructor
+
+    ///Add one weighted OD value
+    inline void Add(const double &_od) {
+        int bin = GetBinIndex(_od);
+        m_counts[bin]++;
+        m_ODSums[bin] += _od;
+    }//end Add
+
+    ///Add all of the values of another histogram with the same bins
+    void Merge(const ODHistogram &_other) {
+        for (int bin = 0; bin <= m_numBins; bin++) {
+            m_counts[bin] += _other.m_counts[bin];
+            m_ODSums[bin] += _other.m_ODSums[bin];
+        }
+    }//end Merge
+
+    ///Bin that an OD value falls into (m_numBins is the overflow bin)
+    inline int GetBinIndex(const double &_od) const {
+        if (_od <= 0.0) { return 0; }
+        //Allow for rounding error when the value is on a bin edge
+        int bin = static_cast<int>(std::floor(_od / GetBinWidth() + 1e-9));
+        return (bin > m_numBins) ? m_numBins : bin;
+    }//end GetBinIndex
+
+    inline double GetBinWidth() const { return m_maxOD / static_cast<double>(m_numBins); }
+    inline double GetMaxOD() const { return m_maxOD; }
+    ///Number of regular bins (excluding the overflow bin)
+    inline int GetNumBins() const { return m_numBins; }
+    inline std::int64_t GetCount(const int &_bin) const { return m_counts[_bin]; }
+    inline double GetODSum(const int &_bin) const { return m_ODSums[_bin]; }
+
+    ///Total number of values added
+    std::int64_t GetTotalCount() const {
+        std::int64_t total = 0;
+        for (auto c : m_counts) { total += c; }
+        return total;
+    }//end GetTotalCount
+
+    ///Number of values retained by a threshold, and their summed OD, to bin resolution
+    //
+    ///Higher retention counts the bins at or above the threshold's bin;
+    ///lower retention counts the bins below it.
+    void GetRetained(const double &_threshold, const bool &_retainHigher,
+        std::int64_t &_count, double &_ODSum) const {
+        int thresholdBin = GetBinIndex(_threshold);
+        int first = _retainHigher ? thresholdBin : 0;
+        int last = _retainHigher ? m_numBins : thresholdBin - 1;
+        _count = 0;
+        _ODSum = 0.0;
+        for (int bin = first; bin <= last; bin++) {
+            _count += m_counts[bin];
+            _ODSum += m_ODSums[bin];
+        }
+    }//end GetRetained
+
+    ///Otsu's threshold: the bin edge that maximizes the variance between the values below and at or above it
+    //
+    ///The class means use the summed OD of each bin, so they are exact rather than bin centers.
+    double GetOtsuThreshold() const {
+        std::int64_t total = GetTotalCount();
+        double totalSum = 0.0;
+        for (auto s : m_ODSums) { totalSum += s; }
+        std::int64_t lowerCount = 0;
+        double lowerSum = 0.0;
+        double bestVariance = -1.0;
+        int bestBin = 0;
+        //Threshold at the lower edge of each bin after the first
+        for (int bin = 1; bin <= m_numBins; bin++) {
+            lowerCount += m_counts[bin - 1];
+            lowerSum += m_ODSums[bin - 1];
+            std::int64_t upperCount = total - lowerCount;
+            if ((0 == lowerCount) || (0 == upperCount)) { continue; }
+            double lowerMean = lowerSum / lowerCount;
+            double upperMean = (totalSum - lowerSum) / upperCount;
+            double variance = static_cast<double>(lowerCount) * static_cast<double>(upperCount)
+                * (upperMean - lowerMean) * (upperMean - lowerMean);
+            if (variance > bestVariance) {
+                bestVariance = variance;
+                bestBin = bin;
+            }
+        }
+        return bestBin * GetBinWidth();
+    }//end GetOtsuThreshold
+
+    ///Triangle threshold: the bin farthest below the line from the peak to the end of the longer tail
+    double GetTriangleThreshold() const {
+        //Find the peak and the first and last occupied regular bins
+        int peak = 0, first = -1, last = -1;
+        for (int bin = 0; bin < m_numBins; bin++) {
+            if (m_counts[bin] > m_counts[peak]) { peak = bin; }
+            if (m_counts[bin] > 0) {
+                if (first < 0) { first = bin; }
+                last = bin;
+            }
+        }
+        if (first < 0) { return 0.0; }
+        //The line runs from the peak to the farther end of the histogram
+        int end = ((last - peak) >= (peak - first)) ? last : first;
+        if (end == peak) { return peak * GetBinWidth(); }
+        double peakCount = static_cast<double>(m_counts[peak]);
+        double endCount = static_cast<double>(m_counts[end]);
+        int step = (end > peak) ? 1 : -1;
+        double bestDistance = -1.0;
+        int bestBin = peak;
+        for (int bin = peak; bin != end; bin += step) {
+            //Height of the line above the bin (proportional to the perpendicular distance)
+            double lineCount = peakCount + (endCount - peakCount) * (bin - peak) / static_cast<double>(end - peak);
+            double distance = lineCount - static_cast<double>(m_counts[bin]);
+            if (distance > bestDistance) {
+                bestDistance = distance;
+                bestBin = bin;
+            }
+        }
+        //Split at the far edge of the chosen bin, toward the tail
+        return ((end > peak) ? bestBin + 1 : bestBin) * GetBinWidth();
+    }//end GetTriangleThreshold
+
+    ///OD below which a percentage (0 to 100) of the values fall, interpolated within a bin
+    double GetPercentileThreshold(const double &_percent) const {
+        std::int64_t total = GetTotalCount();
+        double target = std::min(std::max(_percent, 0.0), 100.0) / 100.0 * static_cast<double>(total);
+        double cumulative = 0.0;
+        for (int bin = 0; bin < m_numBins; bin++) {
+            double count = static_cast<double>(m_counts[bin]);
+            if ((count > 0.0) && (cumulative + count >= target)) {
+                return (bin + (target - cumulative) / count) * GetBinWidth();
+            }
+            cumulative += count;
+        }
+        return m_maxOD;
+    }//end GetPercentileThreshold
+
+private:
+    double m_maxOD;
+    int m_numBins;
+    std::vector<std::int64_t> m_counts;
+    std::vector<double> m_ODSums;
+};
+
+#endif
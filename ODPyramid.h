@@ -0,0 +1,141 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODPYRAMID_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_ODPYRAMID_H
+
+#include "ODConversion.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+///A resolution pyramid of the mean per-channel optical density of a region
+//
+///Averaging RGB values before converting to OD over-weights light pixels, because
+///OD is logarithmic. This pyramid is built by converting full-resolution pixels to
+///OD first, so each cell holds the true mean OD of the pixels within it. It does not
+///depend on the threshold or the weights: a weighted OD is linear in the channel ODs,
+///so the weighted mean OD of a cell is the mean weighted OD of its pixels.
+class ODPyramid {
+public:
+    ///Constructor: size of the full-resolution region, the maximum number of cells in the finest stored level,
+    ///and the conversion of each channel to OD
+    ODPyramid(const int &_width, const int &_height, const int &_maxCells,
+        const ODConversion &_converter = ODConversion()) :
+        m_width(_width),
+        m_height(_height),
+        m_baseShift(0),
+        m_converter(_converter)
+    {
+        //Find the smallest power of two downsampling that fits in _maxCells
+        while ((static_cast<long long>(CellsAlong(m_width, m_baseShift))
+            * CellsAlong(m_height, m_baseShift) > _maxCells)
+            && ((1 << m_baseShift) < std::max(m_width, m_height))) {
+            m_baseShift++;
+        }
+        m_sums.push_back(std::vector<float>(static_cast<std::size_t>(
+            CellsAlong(m_width, m_baseShift)) * CellsAlong(m_height, m_baseShift) * 3, 0.0f));
+    }//end constructor
+
+    virtual ~ODPyramid(void) {
+    }//end destructor
+
+    ///Add the RGB values of a full-resolution pixel at a position in the region
+    inline void AddPixel(const int &_x, const int &_y, const std::array<int, 3> &_rgb) {
+        std::size_t cell = static_cast<std::size_t>(_y >> m_baseShift) 
+            * CellsAlong(m_width, m_baseShift) + (_x >> m_baseShift);
+        float *sums = m_sums.front().data() + 3 * cell;
+        for (int ch = 0; ch < 3; ch++) {
+            sums[ch] += static_cast<float>(m_converter.LookupRGBtoOD(_rgb[ch], ch));
+        }
+    }//end AddPixel
+
+    ///Reduce the finest stored level into coarser levels, down to a single cell
+    void Build() {
+        m_sums.resize(1);
+        while ((GetLevelWidth(GetNumLevels() - 1) > 1) || (GetLevelHeight(GetNumLevels() - 1) > 1)) {
+            int finer = GetNumLevels() - 1;
+            int finerWidth = GetLevelWidth(finer), finerHeight = GetLevelHeight(finer);
+            int shift = m_baseShift + finer + 1;
+            int width = CellsAlong(m_width, shift), height = CellsAlong(m_height, shift);
+            std::vector<float> sums(static_cast<std::size_t>(width) * height * 3, 0.0f);
+            const std::vector<float> &finerSums = m_sums.back();
+            for (int y = 0; y < finerHeight; y++) {
+                for (int x = 0; x < finerWidth; x++) {
+                    std::size_t cell = static_cast<std::size_t>(y / 2) * width + x / 2;
+                    std::size_t finerCell = static_cast<std::size_t>(y) * finerWidth + x;
+                    for (int ch = 0; ch < 3; ch++) {
+                        sums[3 * cell + ch] += finerSums[3 * finerCell + ch];
+                    }
+                }
+            }
+            m_sums.push_back(std::move(sums));
+        }
+    }//end Build
+
+    ///Number of stored levels
+    inline int GetNumLevels() const { return static_cast<int>(m_sums.size()); }
+    ///Downsampling factor of a level relative to the full-resolution region
+    inline int GetLevelFactor(const int &_level) const { return 1 << (m_baseShift + _level); }
+    inline int GetLevelWidth(const int &_level) const { return CellsAlong(m_width, m_baseShift + _level); }
+    inline int GetLevelHeight(const int &_level) const { return CellsAlong(m_height, m_baseShift + _level); }
+
+    ///Choose the finest level whose factor does not exceed the downsampling; -1 if all are coarser
+    int SelectLevel(const double &_downsample) const {
+        int level = -1;
+        for (int l = 0; l < GetNumLevels(); l++) {
+            if (GetLevelFactor(l) <= _downsample) { level = l; }
+        }
+        return level;
+    }//end SelectLevel
+
+    ///Mean OD of each channel of the full-resolution pixels within a cell
+    inline std::array<double, 3> GetMeanOD(const int &_level, const int &_cx, const int &_cy) const {
+        int factor = GetLevelFactor(_level);
+        int cellWidth = std::min(factor, m_width - _cx * factor);
+        int cellHeight = std::min(factor, m_height - _cy * factor);
+        double area = static_cast<double>(cellWidth) * cellHeight;
+        const float *sums = m_sums.at(_level).data() 
+            + 3 * (static_cast<std::size_t>(_cy) * GetLevelWidth(_level) + _cx);
+        return { sums[0] / area, sums[1] / area, sums[2] / area };
+    }//end GetMeanOD
+
+private:
+    ///Number of cells needed to cover a length at a power of two downsampling
+    inline static int CellsAlong(const int &_length, const int &_shift) {
+        return (_length + (1 << _shift) - 1) >> _shift;
+    }//end CellsAlong
+
+private:
+    int m_width;
+    int m_height;
+    ///Downsampling of the finest stored level, as a power of two
+    int m_baseShift;
+    ///Sums of the OD of each channel per cell (interleaved), finest stored level first
+    std::vector<std::vector<float>> m_sums;
+    ODConversion m_converter;
+};
+
+#endif
@@ -24,9 +24,12 @@
 
 #include "ODThresholdKernel.h"
 #include "ODConversion.h"
+#include "PixelAccessor.h"
 
 //C++ headers
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <numeric>
 
 // User header
@@ -50,51 +53,399 @@ namespace {
 
 namespace tile {
     
-ODThresholdKernel::ODThresholdKernel(double ODThreshVal, 
-    Behavior behavior, std::array<double, 3> weights /*= { 1.0,1.0,1.0 }*/) :
+ODThresholdKernel::Parameters::Parameters(double ODThreshVal, 
+    Behavior behavior, std::array<double, 3> weights) :
+    m_version(0),
     m_odThreshVal(ODThreshVal),
     m_behavior(behavior),
-    m_weightVals(weights) {
+    m_weightVals(weights),
+    m_thresholdType(WEIGHTED_OD),
+    m_stainMatrix(StainMatrix::Hematoxylin(), StainMatrix::Eosin()),
+    m_stain(0),
+    m_projection(),
+    m_projectionTables(),
+    m_channelThresholds({ ODThreshVal, ODThreshVal, ODThreshVal }),
+    m_channelRanges(),
+    m_outputType(RETAINED_COLOR),
+    m_colorLUT(nullptr),
+    m_bandThresholds(),
+    //Until setBands() is called, there is one band and it is black
+    m_bandColors({ {{ 0,0,0 }} }),
+    m_heatmapColors({ {{ 255,255,255 }} }),
+    m_heatmapRange(1.0),
+    m_converter() {
+    updateProjection();
+    updateChannelRanges();
+}//end Parameters constructor
+
+ODThresholdKernel::ODThresholdKernel(double ODThreshVal, 
+    Behavior behavior, std::array<double, 3> weights /*= { 1.0,1.0,1.0 }*/) :
+    m_parameters(std::make_shared<const Parameters>(ODThreshVal, behavior, weights)),
+    m_publishMutex(),
+    m_bufferPool(std::make_shared<BufferPool>()),
+    m_cancellation(nullptr),
+    m_generation(0) {
 }//end constructor
 
 ODThresholdKernel::~ODThresholdKernel(void) {
 }//end destructor
 
-void ODThresholdKernel::setODThreshold(double v) {
-    if (m_odThreshVal != v) {
-        m_odThreshVal = v;
-        update();
+std::shared_ptr<const ODThresholdKernel::Parameters> ODThresholdKernel::getParameters() const {
+    return std::atomic_load(&m_parameters);
+}//end getParameters
+
+void ODThresholdKernel::publish(const std::function<bool(Parameters&)> &change) {
+    {
+        std::lock_guard<std::mutex> lock(m_publishMutex);
+        auto changed = std::make_shared<Parameters>(*getParameters());
+        if (false == change(*changed)) {
+            return;
+        }
+        changed->m_version++;
+        //Tiles in flight keep the snapshot they started with
+        std::atomic_store(&m_parameters, std::shared_ptr<const Parameters>(changed));
     }
+    update();
+}//end publish
+
+void ODThresholdKernel::setODThreshold(double v) {
+    publish([&](Parameters &p) {
+        if (p.m_odThreshVal == v) { return false; }
+        p.m_odThreshVal = v;
+        return true;
+    });
 }//end setODThreshold
 
 void ODThresholdKernel::setBehavior(Behavior t) {
-    if (t != m_behavior) {
-        m_behavior = t;
-        update();
-    }
+    publish([&](Parameters &p) {
+        if (p.m_behavior == t) { return false; }
+        p.m_behavior = t;
+        p.updateChannelRanges();
+        return true;
+    });
 }//end setBehavior
 
 void ODThresholdKernel::setWeights(std::array<double, 3> w) {
-    if (w != m_weightVals) {
-        m_weightVals = w;
-        update();
-    }
+    publish([&](Parameters &p) {
+        if (p.m_weightVals == w) { return false; }
+        p.m_weightVals = w;
+        p.updateProjection();
+        return true;
+    });
 }//end setWeights
 
+void ODThresholdKernel::setThresholdType(ThresholdType t) {
+    publish([&](Parameters &p) {
+        if (p.m_thresholdType == t) { return false; }
+        p.m_thresholdType = t;
+        p.updateProjection();
+        return true;
+    });
+}//end setThresholdType
+
+void ODThresholdKernel::setStainMatrix(const StainMatrix &stains, int stain) {
+    publish([&](Parameters &p) {
+        if ((p.m_stainMatrix == stains) && (p.m_stain == stain)) { return false; }
+        p.m_stainMatrix = stains;
+        p.m_stain = stain;
+        p.updateProjection();
+        return true;
+    });
+}//end setStainMatrix
+
+void ODThresholdKernel::setChannelThresholds(std::array<double, 3> t) {
+    publish([&](Parameters &p) {
+        if (p.m_channelThresholds == t) { return false; }
+        p.m_channelThresholds = t;
+        p.updateChannelRanges();
+        return true;
+    });
+}//end setChannelThresholds
+
+void ODThresholdKernel::setOutputType(OutputType t) {
+    publish([&](Parameters &p) {
+        if (p.m_outputType == t) { return false; }
+        p.m_outputType = t;
+        return true;
+    });
+}//end setOutputType
+
+void ODThresholdKernel::setColorLUT(std::shared_ptr<const ColorLUT> lut) {
+    publish([&](Parameters &p) {
+        if (p.m_colorLUT == lut) { return false; }
+        p.m_colorLUT = lut;
+        return true;
+    });
+}//end setColorLUT
+
+void ODThresholdKernel::setConverter(const ODConversion &converter) {
+    publish([&](Parameters &p) {
+        if (p.m_converter == converter) { return false; }
+        p.m_converter = converter;
+        p.updateProjection();
+        p.updateChannelRanges();
+        return true;
+    });
+}//end setConverter
+
+void ODThresholdKernel::setBands(std::vector<double> thresholds, 
+    std::vector<std::array<int, 3>> colors) {
+    std::sort(thresholds.begin(), thresholds.end());
+    //Bands without a color are shown as black
+    colors.resize(thresholds.size() + 1, { 0,0,0 });
+    publish([&](Parameters &p) {
+        if ((p.m_bandThresholds == thresholds) && (p.m_bandColors == colors)) { return false; }
+        p.m_bandThresholds = thresholds;
+        p.m_bandColors = colors;
+        return true;
+    });
+}//end setBands
+
+void ODThresholdKernel::setHeatmap(std::vector<std::array<int, 3>> colors, double range) {
+    //An empty colormap shows retained pixels in white
+    if (colors.empty()) {
+        colors.push_back({ 255,255,255 });
+    }
+    publish([&](Parameters &p) {
+        if ((p.m_heatmapColors == colors) && (p.m_heatmapRange == range)) { return false; }
+        p.m_heatmapColors = colors;
+        p.m_heatmapRange = range;
+        return true;
+    });
+}//end setHeatmap
+
+int ODThresholdKernel::bandLabel(double w_od) const {
+    return getParameters()->bandLabel(w_od);
+}//end bandLabel
+
+double ODThresholdKernel::weightedOD(const std::array<int, 3> &rgb) const {
+    return getParameters()->weightedOD(rgb);
+}//end weightedOD
+
+double ODThresholdKernel::weightedOD(const std::array<double, 3> &od) const {
+    return getParameters()->weightedOD(od);
+}//end weightedOD
+
+bool ODThresholdKernel::isRetained(double w_od) const {
+    return getParameters()->isRetained(w_od);
+}//end isRetained
+
+bool ODThresholdKernel::isRetained(const std::array<int, 3> &rgb) const {
+    return getParameters()->isRetained(rgb);
+}//end isRetained
+
+bool ODThresholdKernel::isRetainedOD(const std::array<double, 3> &od) const {
+    return getParameters()->isRetainedOD(od);
+}//end isRetainedOD
+
+bool ODThresholdKernel::isUniformRange(const std::array<int, 3> &minRGB,
+    const std::array<int, 3> &maxRGB, bool &retained) const {
+    return getParameters()->isUniformRange(minRGB, maxRGB, retained);
+}//end isUniformRange
+
+int ODThresholdKernel::Parameters::bandLabel(double w_od) const {
+    return static_cast<int>(std::upper_bound(m_bandThresholds.begin(), 
+        m_bandThresholds.end(), w_od) - m_bandThresholds.begin());
+}//end bandLabel
+
+void ODThresholdKernel::Parameters::updateChannelRanges() {
+    //OD decreases as the 8-bit value increases, so the values passing a channel
+    //threshold are a contiguous range: [0, cutoff] when retaining higher OD,
+    //[cutoff, 255] when retaining lower OD. Find it once from the lookup table.
+    const int rgbMax = ODConversion::GetRGBMaxValue();
+    for (int ch = 0; ch < 3; ch++) {
+        int first = rgbMax + 1, last = -1;
+        for (int v = 0; v <= rgbMax; v++) {
+            double od = m_converter.LookupRGBtoOD(v, ch);
+            bool passes = ((m_behavior == RETAIN_LOWER_OD)  && (od <= m_channelThresholds[ch]))
+                       || ((m_behavior == RETAIN_HIGHER_OD) && (od >= m_channelThresholds[ch]));
+            if (passes) {
+                first = std::min(first, v);
+                last = std::max(last, v);
+            }
+        }
+        //An empty range is stored as [rgbMax + 1, -1], which no value passes
+        m_channelRanges[ch] = { first, last };
+    }
+}//end updateChannelRanges
+
+void ODThresholdKernel::Parameters::updateProjection() {
+    if (m_thresholdType == STAIN_DECONVOLUTION) {
+        m_stainMatrix.GetUnmixingWeights(m_stain, m_projection);
+    }
+    else {
+        //Check the sum of the weights. Is it zero? Set denominator to 1.0 instead if so
+        double weightSum = std::accumulate(m_weightVals.begin(), m_weightVals.end(), 0.0);
+        double weightDenominator = (weightSum == 0.0) ? 1.0 : weightSum;
+        for (int ch = 0; ch < 3; ch++) {
+            m_projection[ch] = m_weightVals[ch] / weightDenominator;
+        }
+    }
+    //Fold the OD conversion and the weights into one table per channel
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 0; v < static_cast<int>(m_projectionTables[ch].size()); v++) {
+            m_projectionTables[ch][v] = m_projection[ch] * m_converter.LookupRGBtoOD(v, ch);
+        }
+    }
+}//end updateProjection
+
+double ODThresholdKernel::Parameters::weightedOD(const std::array<int, 3> &rgb) const {
+    double w_od(0.0);
+    for (int ch = 0; ch < 3; ch++) {
+        //Values outside the 8-bit tables (e.g. 16-bit images) are converted directly
+        if ((rgb[ch] >= 0) && (rgb[ch] < static_cast<int>(m_projectionTables[ch].size()))) {
+            w_od += m_projectionTables[ch][rgb[ch]];
+        }
+        else {
+            w_od += m_projection[ch] * m_converter.LookupRGBtoOD(rgb[ch], ch);
+        }
+    }
+    return w_od;
+}//end weightedOD
+
+double ODThresholdKernel::Parameters::weightedOD(const std::array<double, 3> &od) const {
+    //Compute the value to compare to the threshold
+    double w_odRunningTotal(0.0);
+    //Loop over the number of channels that should contribute to the comparison value
+    for (int ch = 0; ch < 3; ch++) {
+        w_odRunningTotal += m_projection[ch] * od[ch];
+    }
+    return w_odRunningTotal;
+}//end weightedOD
+
+bool ODThresholdKernel::Parameters::isRetained(double w_od) const {
+    return ((m_behavior == RETAIN_LOWER_OD)  && (w_od <= m_odThreshVal))
+        || ((m_behavior == RETAIN_HIGHER_OD) && (w_od >= m_odThreshVal));
+}//end isRetained
+
+bool ODThresholdKernel::Parameters::isRetained(const std::array<int, 3> &rgb) const {
+    if ((m_thresholdType == COLOR_LUT) && (nullptr != m_colorLUT)) {
+        //The table covers 8-bit colors only; deeper values are clamped to it
+        auto clamp = [](int v) { return std::min(std::max(v, 0), 255); };
+        return m_colorLUT->IsRetained(clamp(rgb[0]), clamp(rgb[1]), clamp(rgb[2]));
+    }
+    if ((m_thresholdType == WEIGHTED_OD) || (m_thresholdType == STAIN_DECONVOLUTION) 
+        || (m_thresholdType == COLOR_LUT)) {
+        return isRetained(weightedOD(rgb));
+    }
+    //The ranges cover the 8-bit values. Deeper values (e.g. 16-bit) are converted to OD,
+    //as the weighted types do, and compared to the channel threshold directly.
+    const int rgbMax = ODConversion::GetRGBMaxValue();
+    for (int ch = 0; ch < 3; ch++) {
+        if ((rgb[ch] < 0) || (rgb[ch] > rgbMax)) {
+            return isRetainedOD({ m_converter.LookupRGBtoOD(rgb[0], 0), 
+                m_converter.LookupRGBtoOD(rgb[1], 1), m_converter.LookupRGBtoOD(rgb[2], 2) });
+        }
+    }
+    int numPassing = 0;
+    for (int ch = 0; ch < 3; ch++) {
+        if ((rgb[ch] >= m_channelRanges[ch][0]) && (rgb[ch] <= m_channelRanges[ch][1])) {
+            numPassing++;
+        }
+    }
+    return (m_thresholdType == PER_CHANNEL_ANY) ? (numPassing > 0) : (numPassing == 3);
+}//end isRetained
+
+bool ODThresholdKernel::Parameters::isRetainedOD(const std::array<double, 3> &od) const {
+    //The color table is indexed by RGB, so look up the color with these channel ODs
+    if ((m_thresholdType == COLOR_LUT) && (nullptr != m_colorLUT)) {
+        return m_colorLUT->IsRetained(m_converter.LookupODtoRGB(od[0], 0), 
+            m_converter.LookupODtoRGB(od[1], 1), m_converter.LookupODtoRGB(od[2], 2));
+    }
+    if ((m_thresholdType == WEIGHTED_OD) || (m_thresholdType == STAIN_DECONVOLUTION)
+        || (m_thresholdType == COLOR_LUT)) {
+        return isRetained(weightedOD(od));
+    }
+    int numPassing = 0;
+    for (int ch = 0; ch < 3; ch++) {
+        if (((m_behavior == RETAIN_LOWER_OD)  && (od[ch] <= m_channelThresholds[ch]))
+         || ((m_behavior == RETAIN_HIGHER_OD) && (od[ch] >= m_channelThresholds[ch]))) {
+            numPassing++;
+        }
+    }
+    return (m_thresholdType == PER_CHANNEL_ANY) ? (numPassing > 0) : (numPassing == 3);
+}//end isRetainedOD
+
+bool ODThresholdKernel::Parameters::isUniformRange(const std::array<int, 3> &minRGB,
+    const std::array<int, 3> &maxRGB, bool &retained) const {
+    //A color table has no order to bound, so only a single color is uniform
+    if ((m_thresholdType == COLOR_LUT) && (nullptr != m_colorLUT)) {
+        retained = isRetained(minRGB);
+        return (minRGB == maxRGB);
+    }
+    if ((m_thresholdType == WEIGHTED_OD) || (m_thresholdType == STAIN_DECONVOLUTION)
+        || (m_thresholdType == COLOR_LUT)) {
+        //Each channel's term is monotonic in its value, increasing or decreasing with the
+        //sign of its weight, so the sum is bounded by the per-channel extremes.
+        //Retention is monotonic in the sum.
+        double lowest(0.0), highest(0.0);
+        for (int ch = 0; ch < 3; ch++) {
+            double termAtMin = m_projection[ch] * m_converter.LookupRGBtoOD(minRGB[ch], ch);
+            double termAtMax = m_projection[ch] * m_converter.LookupRGBtoOD(maxRGB[ch], ch);
+            lowest += std::min(termAtMin, termAtMax);
+            highest += std::max(termAtMin, termAtMax);
+        }
+        retained = isRetained(lowest);
+        return (retained == isRetained(highest));
+    }
+    //The per-channel rules are monotonic in each channel, so the corners decide
+    bool lowestRetained = isRetained(maxRGB);
+    bool highestRetained = isRetained(minRGB);
+    retained = lowestRetained;
+    return (lowestRetained == highestRetained);
+}//end isUniformRange
+
+void ODThresholdKernel::Parameters::computeMask(const std::vector<std::uint8_t> &red, 
+    const std::vector<std::uint8_t> &green, const std::vector<std::uint8_t> &blue, 
+    std::vector<std::uint8_t> &mask) const {
+    std::size_t numPixels = mask.size();
+    if ((m_thresholdType == COLOR_LUT) && (nullptr != m_colorLUT)) {
+        const ColorLUT &lut = *m_colorLUT;
+        for (std::size_t px = 0; px < numPixels; px++) {
+            mask[px] = lut.IsRetained(red[px], green[px], blue[px]) ? 1 : 0;
+        }
+        return;
+    }
+    if ((m_thresholdType == WEIGHTED_OD) || (m_thresholdType == STAIN_DECONVOLUTION)
+        || (m_thresholdType == COLOR_LUT)) {
+        for (std::size_t px = 0; px < numPixels; px++) {
+            mask[px] = isRetained(weightedOD(std::array<int, 3>{ red[px], green[px], blue[px] })) ? 1 : 0;
+        }
+        return;
+    }
+
+    //Per-channel rules are pure 8-bit range compares. These loops have no branches
+    //or lookups, so the compiler can vectorize them over many pixels at a time.
+    const std::uint8_t *r = red.data(), *g = green.data(), *b = blue.data();
+    std::uint8_t *m = mask.data();
+    const int rMin = m_channelRanges[0][0], rMax = m_channelRanges[0][1];
+    const int gMin = m_channelRanges[1][0], gMax = m_channelRanges[1][1];
+    const int bMin = m_channelRanges[2][0], bMax = m_channelRanges[2][1];
+    if (m_thresholdType == PER_CHANNEL_ANY) {
+        for (std::size_t px = 0; px < numPixels; px++) {
+            m[px] = static_cast<std::uint8_t>(((r[px] >= rMin) & (r[px] <= rMax))
+                | ((g[px] >= gMin) & (g[px] <= gMax)) | ((b[px] >= bMin) & (b[px] <= bMax)));
+        }
+    }
+    else {
+        for (std::size_t px = 0; px < numPixels; px++) {
+            m[px] = static_cast<std::uint8_t>(((r[px] >= rMin) & (r[px] <= rMax))
+                & ((g[px] >= gMin) & (g[px] <= gMax)) & ((b[px] >= bMin) & (b[px] <= bMax)));
+        }
+    }
+}//end computeMask
+
 RawImage ODThresholdKernel::doProcessData(const RawImage &source)
 {
-    //Get the ColorSpace and ColorModel of the source
-    ColorSpace sourceColorSpace = source.colorSpace();
-    ColorModel sourceColorModel = sourceColorSpace.colorModel();
-
     //Get the pixel order of the source image: Interleaved or Planar
     PixelOrder pixelOrder = source.order();
-    auto numElements = source.count();
-    int numSourceChannels = static_cast<int>(channels(source));
-    int numPixels = static_cast<int>(numElements / numSourceChannels);
     sedeen::Size imageSize = source.size();
+    PixelAccessor sourcePixels(source);
+    int numPixels = sourcePixels.GetNumPixels();
 
     // Construct the output buffer (copy source properties)
+    //It is not leased from the buffer pool: the returned RawImage owns its pixels, and the
+    //Cache keeps it with no notice of release, so a pooled buffer could never be returned.
     auto buffer = std::make_shared<RawImage>(imageSize, doGetColorSpace(), pixelOrder);
     buffer->fill(ChannelValue(0));
 
@@ -102,74 +453,158 @@ RawImage ODThresholdKernel::doProcessData(const RawImage &source)
     int numOutputChannels = static_cast<int>(channels(*buffer));
     int outputScaleMax = sedeen::maxChannelValue<int>(doGetColorSpace());
 
-    //Perform faster OD conversions using a lookup table
-    std::shared_ptr<ODConversion> converter = std::make_shared<ODConversion>();
+    //The whole tile is processed with one set of parameters, even if a setter runs meanwhile
+    std::shared_ptr<const Parameters> parameters = getParameters();
+    std::shared_ptr<BufferPool> bufferPool = std::atomic_load(&m_bufferPool);
 
-    //Check the sum of the weights. Is it zero? Set denominator to 1.0 instead if so
-    double weightSum = std::accumulate(m_weightVals.begin(), m_weightVals.end(), 0.0);
-    double weightDenominator = (weightSum == 0.0) ? 1.0 : weightSum;
+    //Stop every few rows once the tile is no longer wanted. A null image is returned
+    //instead of a partial or blank tile, so a cancelled tile is never taken for a result.
+    std::shared_ptr<const CancellationToken> cancellation = std::atomic_load(&m_cancellation);
+    std::uint64_t generation = m_generation;
+    int checkPixels = std::max(1, imageSize.width() * CancellationToken::GetCheckRows());
+    auto cancelled = [&](int px) {
+        return (0 == px % checkPixels) && (nullptr != cancellation) 
+            && cancellation->IsCancelled(generation);
+    };
 
-    //Loop through all pixels in the source
-    for (int px = 0; px < numPixels; px++) {
-        //Sets of indices corresponding to the elements of a pixel in the source and output
-        std::vector<int> sourceIndices, outputIndices, srcToOutIndex;
-        //If source is Grayscale, use source channel 0 for all.
-        if ((sourceColorModel == ColorModel::Grayscale) || (numSourceChannels == 1)) {
-            srcToOutIndex = { 0,0,0 };
+    //Read an 8-bit source into separate R, G and B planes, in buffers reused from earlier tiles.
+    //Deeper sources (e.g. 16-bit) would not fit the planes, so their pixels are read directly.
+    bool eightBit = (sedeen::maxChannelValue<int>(source.colorSpace()) <= 255);
+    int planePixels = eightBit ? numPixels : 0;
+    BufferPool::Lease redLease = bufferPool->Acquire(planePixels);
+    BufferPool::Lease greenLease = bufferPool->Acquire(planePixels);
+    BufferPool::Lease blueLease = bufferPool->Acquire(planePixels);
+    BufferPool::Lease maskLease = bufferPool->Acquire(numPixels);
+    std::vector<std::uint8_t> &red = redLease.Get(), &green = greenLease.Get(), 
+        &blue = blueLease.Get(), &mask = maskLease.Get();
+    for (int px = 0; px < planePixels; px++) {
+        if (cancelled(px)) {
+            return RawImage();
         }
-        else {
-            srcToOutIndex = { 0,1,2 };
+        std::array<int, 3> rgb = sourcePixels.GetRGB(px);
+        red[px] = static_cast<std::uint8_t>(rgb[0]);
+        green[px] = static_cast<std::uint8_t>(rgb[1]);
+        blue[px] = static_cast<std::uint8_t>(rgb[2]);
+    }
+    auto rgbAt = [&](int px) {
+        return eightBit ? std::array<int, 3>{ red[px], green[px], blue[px] } : sourcePixels.GetRGB(px);
+    };
+    //Threshold the planes in one pass, or deeper pixels one by one; FALSE if cancelled
+    auto fillMask = [&]() {
+        if (eightBit) {
+            parameters->computeMask(red, green, blue, mask);
+            return true;
         }
-        int srcToOutSize = static_cast<int>(srcToOutIndex.size());
+        for (int px = 0; px < numPixels; px++) {
+            if (cancelled(px)) {
+                return false;
+            }
+            mask[px] = parameters->isRetained(sourcePixels.GetRGB(px)) ? 1 : 0;
+        }
+        return true;
+    };
 
-        //Loop through channels, get indices based on PixelOrder
-        if (pixelOrder == PixelOrder::Interleaved) {
-            for (int ch = 0; ch < srcToOutSize; ch++) {
-                //RGB RGB RGB ... (if numChannels=3)
-                //index.push_back(pixel*numChannels + channel);
-                sourceIndices.push_back(px*numSourceChannels + srcToOutIndex.at(ch));
-                outputIndices.push_back(px*numOutputChannels + ch);
+    //Color each pixel by its intensity band
+    if (parameters->m_outputType == LABEL_MAP) {
+        for (int px = 0; px < numPixels; px++) {
+            if (cancelled(px)) {
+                return RawImage();
             }
-            outputIndices.push_back(px*numOutputChannels + srcToOutSize);
-        }
-        else if (pixelOrder == PixelOrder::Planar) {
-            for (int ch = 0; ch < srcToOutSize; ch++) {
-                //RRR... GGG... BBB...
-                //index.push_back(channel*numPixels + pixel);
-                sourceIndices.push_back(srcToOutIndex.at(ch)*numPixels + px);
-                outputIndices.push_back(ch*numPixels + px);
+            double w_od = parameters->weightedOD(rgbAt(px));
+            const std::array<int, 3> &color = parameters->m_bandColors.at(parameters->bandLabel(w_od));
+            for (int ch = 0; ch < 3; ch++) {
+                buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                    numOutputChannels, px, ch), color[ch]);
             }
-            outputIndices.push_back(srcToOutSize*numPixels + px);
+            buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                numOutputChannels, px, numOutputChannels - 1), outputScaleMax);
         }
-        else {
-            //Invalid value of pixelOrder
-            assert(false && "Invalid PixelOrder defined");
+        return *buffer;
+    }
+
+    if (cancelled(0) || (false == fillMask())) {
+        return RawImage();
+    }
+
+    //Color retained pixels by their distance from the threshold; the rest stay transparent
+    if (parameters->m_outputType == HEATMAP) {
+        int lastColor = static_cast<int>(parameters->m_heatmapColors.size()) - 1;
+        for (int px = 0; px < numPixels; px++) {
+            if (cancelled(px)) {
+                return RawImage();
+            }
+            if (0 == mask[px]) {
+                continue;
+            }
+            double w_od = parameters->weightedOD(rgbAt(px));
+            int index = lastColor;
+            if (parameters->m_heatmapRange > 0.0) {
+                double position = std::abs(w_od - parameters->m_odThreshVal) 
+                    / parameters->m_heatmapRange * lastColor;
+                index = std::min(lastColor, static_cast<int>(position));
+            }
+            const std::array<int, 3> &color = parameters->m_heatmapColors[index];
+            for (int ch = 0; ch < 3; ch++) {
+                buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                    numOutputChannels, px, ch), color[ch]);
+            }
+            buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                numOutputChannels, px, numOutputChannels - 1), outputScaleMax);
         }
+        return *buffer;
+    }
 
-        //Compute the value to compare to the threshold
-        double w_odRunningTotal(0.0), w_odVal(0.0);
-        //Loop over the number of channels that should contribute to the comparison value
-        for (int ch = 0; ch < sourceIndices.size(); ch++) {
-            //Get the channel in the source image that should be accessed
-            w_odRunningTotal += m_weightVals.at(ch) 
-                * converter->LookupRGBtoOD(source.at(sourceIndices.at(ch)).as<int>());
+    //Keep the source color of every pixel; only the alpha channel depends on the mask
+    if (parameters->m_outputType == ALPHA_MASK) {
+        for (int px = 0; px < numPixels; px++) {
+            if (cancelled(px)) {
+                return RawImage();
+            }
+            std::array<int, 3> rgb = rgbAt(px);
+            for (int ch = 0; ch < 3; ch++) {
+                buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                    numOutputChannels, px, ch), rgb[ch]);
+            }
+            buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels,
+                numOutputChannels, px, numOutputChannels - 1), mask[px] ? outputScaleMax : 0);
         }
-        w_odVal = w_odRunningTotal / weightDenominator;
+        return *buffer;
+    }
 
-        //Check w_odVal against the m_odThreshVal, assign 
-        if ( ((m_behavior == RETAIN_LOWER_OD)  && (w_odVal <= m_odThreshVal))
-          || ((m_behavior == RETAIN_HIGHER_OD) && (w_odVal >= m_odThreshVal)) ) {
-            for (int si = 0; si < sourceIndices.size(); si++) {
-                buffer->setValue(outputIndices.at(si), source.at(sourceIndices.at(si)));
+    //Loop through all pixels in the source
+    for (int px = 0; px < numPixels; px++) {
+        if (cancelled(px)) {
+            return RawImage();
+        }
+        //Copy the source color of retained pixels
+        if (mask[px]) {
+            std::array<int, 3> rgb = rgbAt(px);
+            for (int ch = 0; ch < 3; ch++) {
+                buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels, 
+                    numOutputChannels, px, ch), rgb[ch]);
             }
         }
         //Set the last element of each output pixel
-        buffer->setValue(outputIndices.back(), outputScaleMax);
+        buffer->setValue(PixelAccessor::GetIndex(pixelOrder, numPixels, 
+            numOutputChannels, px, numOutputChannels - 1), outputScaleMax);
     }//end for px
 
     return *buffer;
 }//end doProcessData
 
+void ODThresholdKernel::setBufferPool(std::shared_ptr<BufferPool> pool) {
+    if (nullptr != pool) {
+        std::atomic_store(&m_bufferPool, pool);
+    }
+}//end setBufferPool
+
+void ODThresholdKernel::setCancellationToken(std::shared_ptr<const CancellationToken> token) {
+    if (nullptr != token) {
+        m_generation = token->GetGeneration();
+    }
+    std::atomic_store(&m_cancellation, token);
+}//end setCancellationToken
+
 const ColorSpace& ODThresholdKernel::doGetColorSpace() const {
     return OutputColor;
 }
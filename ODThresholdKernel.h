@@ -28,8 +28,18 @@
 #include "image/filter/Kernel.h"
 
 #include "ODConversion.h"
+#include "StainMatrix.h"
+#include "ColorLUT.h"
+#include "BufferPool.h"
+#include "CancellationToken.h"
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace sedeen {
 
@@ -59,7 +69,100 @@ public:
         /// Do nothing
         NO_ACTION
     };
+
+    /// How the optical density of the R, G and B elements of a pixel is compared to the threshold
+    enum ThresholdType {
+        /// Compare the weighted average of the channel optical densities to the threshold value
+        WEIGHTED_OD,
+        /// Retain pixels for which any channel passes its own threshold
+        PER_CHANNEL_ANY,
+        /// Retain pixels for which all channels pass their own thresholds
+        PER_CHANNEL_ALL,
+        /// Compare the amount of one stain, from color deconvolution of the channel optical densities
+        STAIN_DECONVOLUTION,
+        /// Look up the retain/reject decision of each RGB triple in a color table
+        COLOR_LUT
+    };
+
+    /// What the kernel writes to the output image
+    enum OutputType {
+        /// The source color of retained pixels, black for pixels that are not retained
+        RETAINED_COLOR,
+        /// The color of the intensity band of each pixel's weighted optical density
+        LABEL_MAP,
+        /// Retained pixels colored by how far their weighted optical density is from the threshold,
+        /// transparent for pixels that are not retained
+        HEATMAP,
+        /// The source color of every pixel, opaque when retained and transparent (alpha 0) when not,
+        /// so the viewer blends the mask over the slide
+        ALPHA_MASK
+    };
     
+    /// An immutable snapshot of the kernel's parameters, with the lookup tables derived from them
+    //
+    /// The setters publish a changed copy instead of changing the current snapshot, so a tile
+    /// (or a batch of queries) holding a snapshot sees one consistent set of parameters while
+    /// the parameters change, without taking a lock.
+    struct Parameters {
+        Parameters(double ODThreshVal, Behavior behavior, std::array<double, 3> weights);
+
+        /// \copydoc ODThresholdKernel::bandLabel()
+        int bandLabel(double w_od) const;
+        /// \copydoc ODThresholdKernel::weightedOD(const std::array<int, 3>&) const
+        double weightedOD(const std::array<int, 3> &rgb) const;
+        /// \copydoc ODThresholdKernel::weightedOD(const std::array<double, 3>&) const
+        double weightedOD(const std::array<double, 3> &od) const;
+        /// \copydoc ODThresholdKernel::isRetained(double) const
+        bool isRetained(double w_od) const;
+        /// \copydoc ODThresholdKernel::isRetained(const std::array<int, 3>&) const
+        bool isRetained(const std::array<int, 3> &rgb) const;
+        /// \copydoc ODThresholdKernel::isRetainedOD()
+        bool isRetainedOD(const std::array<double, 3> &od) const;
+        /// \copydoc ODThresholdKernel::isUniformRange()
+        bool isUniformRange(const std::array<int, 3> &minRGB,
+            const std::array<int, 3> &maxRGB, bool &retained) const;
+
+        /// Fill \p mask with 1 for retained pixels and 0 otherwise, from the R, G and B planes of a tile
+        void computeMask(const std::vector<std::uint8_t> &red, const std::vector<std::uint8_t> &green,
+            const std::vector<std::uint8_t> &blue, std::vector<std::uint8_t> &mask) const;
+
+        /// Recalculate m_projection and m_projectionTables from the threshold type and weights or stains
+        void updateProjection();
+
+        /// Recalculate m_channelRanges from the channel thresholds and behavior
+        void updateChannelRanges();
+
+        /// Incremented for each published snapshot, e.g. to tag results computed from it
+        std::uint64_t m_version;
+        double m_odThreshVal;
+        Behavior m_behavior;
+        std::array<double, 3> m_weightVals;
+        ThresholdType m_thresholdType;
+        /// The stain vectors and chosen stain of the STAIN_DECONVOLUTION threshold type
+        StainMatrix m_stainMatrix;
+        int m_stain;
+        /// Weights that combine the channel ODs into the value compared to the threshold
+        std::array<double, 3> m_projection;
+        /// The weighted OD of each 8-bit value of each channel, so a pixel costs three lookups
+        std::array<std::array<double, 256>, 3> m_projectionTables;
+        std::array<double, 3> m_channelThresholds;
+        /// Inclusive range of 8-bit values [min, max] that pass each channel's threshold
+        std::array<std::array<int, 2>, 3> m_channelRanges;
+        OutputType m_outputType;
+        /// The decisions of the COLOR_LUT threshold type
+        std::shared_ptr<const ColorLUT> m_colorLUT;
+        /// Increasing weighted OD thresholds between intensity bands
+        std::vector<double> m_bandThresholds;
+        /// One color per intensity band
+        std::vector<std::array<int, 3>> m_bandColors;
+        /// Colormap of the HEATMAP output type, and the weighted OD distance it spans
+        std::vector<std::array<int, 3>> m_heatmapColors;
+        double m_heatmapRange;
+
+        /// Perform faster OD conversions using a lookup table per channel, linearized and relative to the white point
+        ODConversion m_converter;
+    };
+
     /// Creates an optical density thresholding Kernel 
     //
     /// \param ODThreshVal
@@ -91,6 +194,123 @@ public:
     /// The weights to apply to OD_R, OD_G, OD_B to get a single OD value
     void setWeights(std::array<double,3> w);
 
+    /// Set how channel optical densities are compared to the threshold
+    /// \param t
+    /// The threshold type
+    void setThresholdType(ThresholdType t);
+
+    /// Set the per-channel OD threshold values, used by the PER_CHANNEL threshold types
+    /// \param t
+    /// The OD thresholds of the R, G and B channels
+    void setChannelThresholds(std::array<double, 3> t);
+
+    /// Set what the kernel writes to the output image
+    /// \param t
+    /// The output type
+    void setOutputType(OutputType t);
+
+    /// Set the stain matrix and stain used by the STAIN_DECONVOLUTION threshold type
+    /// \param stains
+    /// The stain optical density vectors
+    /// \param stain
+    /// Index (0 to 2) of the stain whose amount is compared to the threshold
+    void setStainMatrix(const StainMatrix &stains, int stain);
+
+    /// Set the color table used by the COLOR_LUT threshold type
+    /// \param lut
+    /// The retain/reject decision of every RGB triple. Without one, COLOR_LUT compares the weighted OD.
+    void setColorLUT(std::shared_ptr<const ColorLUT> lut);
+
+    /// Set the conversion of each channel to optical density
+    /// \param converter
+    /// The per-channel lookup tables, with their white point (I0) and linearization curves
+    void setConverter(const ODConversion &converter);
+
+    /// Set the intensity bands used by the LABEL_MAP output type
+    /// \param thresholds
+    /// N weighted OD thresholds, defining N+1 bands. They are sorted into increasing order.
+    /// \param colors
+    /// N+1 RGB colors, one per band from lowest to highest OD. Bands without a color are black.
+    /// Until this is called, every pixel is in a single black band.
+    void setBands(std::vector<double> thresholds, std::vector<std::array<int, 3>> colors);
+
+    /// Set the colormap used by the HEATMAP output type
+    /// \param colors
+    /// RGB colors from nearest to farthest from the threshold
+    /// \param range
+    /// Distance in weighted OD from the threshold that maps to the last color; farther pixels use it too
+    void setHeatmap(std::vector<std::array<int, 3>> colors, double range);
+
+    /// Set the pool that the per-tile working buffers (color planes and mask) are leased from
+    //
+    /// The output image is allocated per tile, since a RawImage cannot be built over a leased buffer
+    /// \param pool
+    /// A pool shared with other kernels, so buffers are reused when the kernel is rebuilt
+    void setBufferPool(std::shared_ptr<BufferPool> pool);
+
+    /// Set the token that tells tiles in progress to stop
+    /// \param token
+    /// The kernel's tiles belong to the token's current generation. They stop within
+    /// CancellationToken::GetCheckRows() rows once it is cancelled, and return an empty image.
+    /// A Cache over the kernel may keep such images, so it must be dropped when the token is cancelled.
+    void setCancellationToken(std::shared_ptr<const CancellationToken> token);
+
+    /// Get the current parameters, for a batch of queries that must see the same parameters
+    //
+    /// Each of the query methods below loads the current snapshot, which takes a lock in some
+    /// standard libraries, so per-pixel loops should query one snapshot instead.
+    /// \return
+    /// An immutable snapshot; later changes to the kernel publish a new one
+    std::shared_ptr<const Parameters> getParameters() const;
+
+    /// Get the intensity band of a weighted optical density value
+    /// \param w_od
+    /// A weighted optical density value, as returned by weightedOD()
+    /// \return
+    /// The number of band thresholds at or below \p w_od (0 to N)
+    int bandLabel(double w_od) const;
+
+    /// Get the weighted optical density of an RGB pixel
+    /// \param rgb
+    /// The R, G and B values of the pixel (0 to 255)
+    /// \return
+    /// The OD of each channel combined using the kernel's weights. With the 
+    /// STAIN_DECONVOLUTION threshold type, the weights are the unmixing weights
+    /// of the chosen stain, so this is the amount of that stain.
+    double weightedOD(const std::array<int, 3> &rgb) const;
+
+    /// Get the weighted optical density from the optical density of each channel
+    /// \param od
+    /// The R, G and B optical density values
+    double weightedOD(const std::array<double, 3> &od) const;
+
+    /// Check whether a weighted optical density value is retained by the threshold
+    /// \param w_od
+    /// A weighted optical density value, as returned by weightedOD()
+    bool isRetained(double w_od) const;
+
+    /// Check whether an RGB pixel is retained, using the kernel's threshold type
+    /// \param rgb
+    /// The R, G and B values of the pixel (0 to 255). Deeper values are converted to OD with the converter.
+    bool isRetained(const std::array<int, 3> &rgb) const;
+
+    /// Check whether a pixel with the given channel optical densities is retained, using the kernel's threshold type
+    /// \param od
+    /// The R, G and B optical density values
+    bool isRetainedOD(const std::array<double, 3> &od) const;
+
+    /// Check whether all pixels with channel values between two RGB bounds get the same decision
+    /// \param minRGB
+    /// The per-channel minimum R, G and B values
+    /// \param maxRGB
+    /// The per-channel maximum R, G and B values
+    /// \param retained
+    /// Set to the decision shared by all such pixels, if there is one
+    /// \return
+    /// TRUE if every pixel in the range gets the same decision, FALSE otherwise
+    bool isUniformRange(const std::array<int, 3> &minRGB, 
+        const std::array<int, 3> &maxRGB, bool &retained) const;
+
 private:
 	/// \cond INTERNAL
 
@@ -99,14 +319,30 @@ private:
     /// The output of this Kernel is the same color space as the source image,
     /// with the same colors as the source when retained, or black (i.e. 0) when not retained by the threshold.
     /// This depends on the threshold value, Behavior, and OD weights.
+    /// With the LABEL_MAP output type, each pixel is the color of its intensity band instead.
+    /// With the HEATMAP output type, retained pixels are the colormap color of their distance
+    /// from the threshold, and the others are transparent (alpha 0).
+    /// With the ALPHA_MASK output type, every pixel keeps its source color and only the
+    /// alpha channel carries the mask.
     virtual RawImage doProcessData(const RawImage &source);
 
     ///Return the output ColorSpace of this kernel, which is fixed as RGBA
     virtual const ColorSpace& doGetColorSpace() const;
 
-    double m_odThreshVal;
-    ODThresholdKernel::Behavior m_behavior;
-    std::array<double, 3> m_weightVals;
+    /// Publish a changed copy of the current parameters
+    /// \param change
+    /// Changes the copy, and returns FALSE if there was nothing to change
+    void publish(const std::function<bool(Parameters&)> &change);
+
+    /// The current parameters; replaced, never modified, by the setters
+    std::shared_ptr<const Parameters> m_parameters;
+    /// Serializes the setters, so no change is lost; readers do not take it
+    std::mutex m_publishMutex;
+    /// Source of the R, G, B planes and mask of each tile
+    std::shared_ptr<BufferPool> m_bufferPool;
+    /// Checked every few rows of a tile, with the generation the kernel belongs to
+    std::shared_ptr<const CancellationToken> m_cancellation;
+    std::atomic<std::uint64_t> m_generation;
 
     /// \endcond
 };
@@ -32,6 +32,15 @@
 #include "image/io/Image.h"
 #include "image/tile/Factory.h"
 
+#include "PixelAccessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iomanip>
+#include <sstream>
+
 // Poco header needed for the macros below 
 #include <Poco/ClassLibrary.h>
 
@@ -49,25 +58,137 @@ OpticalDensityThreshold::OpticalDensityThreshold()
     : m_displayArea(),
     m_regionToProcess(),
     m_threshold(),
+    m_autoThreshold(),
+    m_autoPercentile(),
     m_retainment(),
     m_thresholdType(),
     m_RWeight(),
     m_GWeight(),
     m_BWeight(),
+    m_stainMatrix(),
+    m_stainToThreshold(),
+    m_estimateWhitePoint(),
+    m_linearization(),
+    m_gamma(),
+    m_estimateStains(),
+    m_hueMin(),
+    m_hueMax(),
+    m_retainedSamples(),
+    m_rejectedSamples(),
+    m_outputType(),
+    m_smoothingSigma(),
+    m_adaptiveMethod(),
+    m_adaptiveRadius(),
+    m_adaptiveK(),
+    m_morphology(),
+    m_morphologyRadius(),
+    m_weakThreshold(),
+    m_moderateThreshold(),
+    m_strongThreshold(),
+    m_heatmapRange(),
+    m_RThreshold(),
+    m_GThreshold(),
+    m_BThreshold(),
+    m_zoomedOutDisplay(),
+    m_reportResponse(),
+    m_reportIndexed(),
+    m_reportHScore(),
+    m_reportObjects(),
+    m_objectMinArea(),
+    m_indexLevel(),
     m_result(),
     m_outputText(),
     m_report(""),
     m_thresholdDefaultVal(0.20),
     m_thresholdMaxVal(3.0),
     m_thresholdStepSizeVal(0.01),
-    m_ODThreshold_factory(nullptr)
+    m_streamTileSize(512),
+    m_maskPyramidMaxCells(2048 * 2048),
+    m_incrementalMaskMaxPixels(32 * 1024 * 1024),
+    m_ODThreshold_factory(nullptr),
+    m_kernelFactory(nullptr),
+    m_kernelVersion(0),
+    m_stopPollInterval(20),
+    m_ODThreshold_kernel(nullptr),
+    m_maskPyramid(nullptr),
+    m_maskPyramidRegion(),
+    m_tileSummary(nullptr),
+    m_incrementalMask(nullptr),
+    m_incrementalMaskRange(0, 0),
+    m_ODPyramid(nullptr),
+    m_ODPyramidRegion(),
+    m_responseHistogram(nullptr),
+    m_responseHistogramBins(3000),
+    m_integralHistograms(),
+    m_integralHistogramBins(300),
+    m_objectReport(""),
+    m_objectReportMaxRows(1000),
+    m_sauvolaRange(0.5),
+    m_autoHistogram(nullptr),
+    m_autoThresholdValue(0.0),
+    m_autoHistogramMaxPixels(1024 * 1024),
+    m_stainEstimate(nullptr),
+    m_stainEstimateMaxPixels(512 * 512),
+    m_converter(),
+    m_whitePoint(ODConversion::GetDefaultWhitePoint()),
+    m_whitePointSampled(false),
+    m_converterChanged(false),
+    m_colorLUT(nullptr),
+    m_colorLUTKey(),
+    m_bufferPool(std::make_shared<BufferPool>()),
+    m_cancellation(std::make_shared<CancellationToken>())
 {
     //List the options for retainment type
     m_retainmentOptions.push_back("Lower OD (retain lighter)");
     m_retainmentOptions.push_back("Higher OD (retain darker)");
 
+    m_autoThresholdOptions.push_back("Manual (OD Threshold value)");
+    m_autoThresholdOptions.push_back("Otsu");
+    m_autoThresholdOptions.push_back("Triangle");
+    m_autoThresholdOptions.push_back("Percentile");
+
     m_thresholdTypeOptions.push_back("Average OD");
     m_thresholdTypeOptions.push_back("Weighted Average OD");
+    m_thresholdTypeOptions.push_back("Per-channel OD (any channel)");
+    m_thresholdTypeOptions.push_back("Per-channel OD (all channels)");
+    m_thresholdTypeOptions.push_back("Color deconvolution (stain OD)");
+    m_thresholdTypeOptions.push_back("Color classification (OD and hue)");
+
+    m_stainMatrixOptions.push_back("Hematoxylin and Eosin");
+    m_stainMatrixOptions.push_back("Hematoxylin and DAB");
+    m_stainMatrixOptions.push_back("Hematoxylin, Eosin and DAB");
+
+    m_stainToThresholdOptions.push_back("Stain 1");
+    m_stainToThresholdOptions.push_back("Stain 2");
+    m_stainToThresholdOptions.push_back("Stain 3");
+
+    m_outputTypeOptions.push_back("Retained pixels");
+    m_outputTypeOptions.push_back("Intensity bands (label map)");
+    m_outputTypeOptions.push_back("OD heatmap (distance from threshold)");
+    m_outputTypeOptions.push_back("Retained pixels over slide (alpha mask)");
+
+    m_adaptiveMethodOptions.push_back("Off (global threshold)");
+    m_adaptiveMethodOptions.push_back("Niblack (mean + k x std)");
+    m_adaptiveMethodOptions.push_back("Sauvola (mean x (1 + k x (std / R - 1)))");
+
+    m_morphologyOptions.push_back("None");
+    m_morphologyOptions.push_back("Erode");
+    m_morphologyOptions.push_back("Dilate");
+    m_morphologyOptions.push_back("Open (remove specks)");
+    m_morphologyOptions.push_back("Close (fill holes)");
+
+    m_linearizationOptions.push_back("None (OD of encoded values)");
+    m_linearizationOptions.push_back("sRGB curve");
+    m_linearizationOptions.push_back("Gamma curve");
+
+    m_bandNames = { "Negative", "Weak", "Moderate", "Strong" };
+    m_bandColors = { {{ 0,0,255 }}, {{ 255,255,0 }}, {{ 255,128,0 }}, {{ 255,0,0 }} };
+    m_heatmapColors = getHeatmapColors();
+
+    m_zoomedOutDisplayOptions.push_back("Threshold downsampled image");
+    m_zoomedOutDisplayOptions.push_back("Full-resolution mask (coverage)");
+    m_zoomedOutDisplayOptions.push_back("Full-resolution mask (majority)");
+    m_zoomedOutDisplayOptions.push_back("Threshold mean OD pyramid");
 }//end  constructor
 
  //Destructor
@@ -83,7 +204,7 @@ void OpticalDensityThreshold::init(const image::ImageHandle& image) {
 
     //Assemble the user interface
     m_thresholdType = createOptionParameter(*this, "Threshold type",
-        "Choose how to calculate the integrated optical density: average, or use uneven weights for the RGB pixel components",
+        "Choose how to calculate the integrated optical density: average, or use uneven weights for the RGB pixel components. Per-channel types compare each RGB component to its own threshold, and retain the pixel if any or all of them pass. Color classification also requires the pixel's hue to be in a range",
         0, m_thresholdTypeOptions, false);
 
     m_retainment = createOptionParameter(*this, "Retain pixels",
@@ -99,6 +220,19 @@ void OpticalDensityThreshold::init(const image::ImageHandle& image) {
         m_thresholdStepSizeVal,
         false);
 
+    m_autoThreshold = createOptionParameter(*this, "Automatic threshold",
+        "Choose the threshold value from a weighted OD histogram of a low resolution level of the ROI (or whole slide), instead of the OD Threshold value (weighted and stain OD threshold types)",
+        0, m_autoThresholdOptions, false);
+
+    m_autoPercentile = createDoubleParameter(*this,
+        "Threshold percentile",   // Widget label
+        "Percentage of pixels with weighted OD below the threshold, used by the Percentile automatic threshold",
+        90.0,  // Initial value
+        0.0,   // minimum value
+        100.0, // maximum value
+        0.5,
+        false);
+
     m_RWeight = createDoubleParameter(*this,
         "Red weight",   // Widget label
         "Weight to apply to the Red optical density component of the pixel when comparing to the threshold value",
@@ -123,11 +257,207 @@ void OpticalDensityThreshold::init(const image::ImageHandle& image) {
         10.0,  // maximum value
         false);
 
+    m_stainMatrix = createOptionParameter(*this, "Stain vectors",
+        "Stain optical density vectors used by the color deconvolution threshold type",
+        0, m_stainMatrixOptions, false);
+
+    m_stainToThreshold = createOptionParameter(*this, "Stain to threshold",
+        "Which stain's optical density the color deconvolution threshold type compares to the threshold value",
+        0, m_stainToThresholdOptions, false);
+
+    m_estimateWhitePoint = createBoolParameter(*this, "Estimate background white point",
+        "Estimate the background (glass) value of each channel from a low resolution level of the whole slide, and measure optical density relative to it instead of 255",
+        false, false);
+
+    m_linearization = createOptionParameter(*this, "Linearization",
+        "Tone curve that decodes the scanner's RGB values to linear intensity before the OD conversion, e.g. the curve of the image's ICC profile",
+        0, m_linearizationOptions, false);
+
+    m_gamma = createDoubleParameter(*this,
+        "Gamma",   // Widget label
+        "Exponent of the Gamma curve linearization",
+        2.2,   // Initial value
+        1.0,   // minimum value
+        3.0,   // maximum value
+        0.1,
+        false);
+
+    m_estimateStains = createBoolParameter(*this, "Estimate stains from slide",
+        "Estimate the OD vectors of two stains from a low resolution level of the ROI (or whole slide). They replace the stain vectors of the color deconvolution type, and the chosen stain's vector replaces the weights of the Weighted Average OD type",
+        false, false);
+
+    m_hueMin = createDoubleParameter(*this,
+        "Hue from",   // Widget label
+        "Start of the hue range (degrees, 0 = red, 120 = green, 240 = blue) of pixels retained by the color classification threshold type",
+        0.0,   // Initial value
+        0.0,   // minimum value
+        360.0, // maximum value
+        1.0,
+        false);
+
+    m_hueMax = createDoubleParameter(*this,
+        "Hue to",   // Widget label
+        "End of the hue range of pixels retained by the color classification threshold type. A range that ends before it starts wraps through red",
+        360.0, // Initial value
+        0.0,   // minimum value
+        360.0, // maximum value
+        1.0,
+        false);
+
+    m_outputType = createOptionParameter(*this, "Output",
+        "Choose whether to show the retained pixels, a label map of weak, moderate and strong intensity bands of weighted OD, a heatmap of how far retained pixels are from the threshold, or the slide with pixels that are not retained made transparent",
+        0, m_outputTypeOptions, false);
+
+    m_weakThreshold = createDoubleParameter(*this,
+        "Weak band OD",   // Widget label
+        "Lowest weighted optical density of the weak intensity band",
+        0.2,                   // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_moderateThreshold = createDoubleParameter(*this,
+        "Moderate band OD",   // Widget label
+        "Lowest weighted optical density of the moderate intensity band",
+        0.5,                   // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_strongThreshold = createDoubleParameter(*this,
+        "Strong band OD",   // Widget label
+        "Lowest weighted optical density of the strong intensity band",
+        1.0,                   // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_heatmapRange = createDoubleParameter(*this,
+        "Heatmap OD range",   // Widget label
+        "Distance in weighted optical density from the threshold that spans the heatmap colors, from blue at the threshold to red",
+        1.0,                   // Initial value
+        m_thresholdStepSizeVal, // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_RThreshold = createDoubleParameter(*this,
+        "Red OD threshold",   // Widget label
+        "Optical Density threshold value of the Red channel, used by the per-channel threshold types",
+        m_thresholdDefaultVal, // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_GThreshold = createDoubleParameter(*this,
+        "Green OD threshold",   // Widget label
+        "Optical Density threshold value of the Green channel, used by the per-channel threshold types",
+        m_thresholdDefaultVal, // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_BThreshold = createDoubleParameter(*this,
+        "Blue OD threshold",   // Widget label
+        "Optical Density threshold value of the Blue channel, used by the per-channel threshold types",
+        m_thresholdDefaultVal, // Initial value
+        0.0,                   // minimum value
+        m_thresholdMaxVal,     // maximum value
+        m_thresholdStepSizeVal,
+        false);
+
+    m_smoothingSigma = createDoubleParameter(*this,
+        "OD smoothing (sigma)",   // Widget label
+        "Standard deviation (in full-resolution pixels) of a Gaussian blur of the channel optical densities before the threshold mask is made. 0 is no smoothing.",
+        0.0,   // Initial value
+        0.0,   // minimum value
+        5.0,   // maximum value
+        0.1,
+        false);
+
+    m_adaptiveMethod = createOptionParameter(*this, "Adaptive threshold",
+        "Replace the global threshold value with a local threshold from the mean and standard deviation of the weighted OD in a window around each pixel (weighted and stain OD threshold types)",
+        0, m_adaptiveMethodOptions, false);
+
+    m_adaptiveRadius = createIntegerParameter(*this, "Adaptive window radius",
+        "Radius (in full-resolution pixels) of the square window of the adaptive threshold",
+        64,    // Initial value
+        1,     // minimum value
+        1000,  // maximum value
+        false);
+
+    m_adaptiveK = createDoubleParameter(*this,
+        "Adaptive k",   // Widget label
+        "Weight of the local standard deviation in the adaptive threshold",
+        0.2,   // Initial value
+        -1.0,  // minimum value
+        1.0,   // maximum value
+        0.05,
+        false);
+
+    m_morphology = createOptionParameter(*this, "Mask cleanup",
+        "Morphological operation applied to the threshold mask of the retained pixels output, the mask pyramid and the object report",
+        0, m_morphologyOptions, false);
+
+    m_morphologyRadius = createIntegerParameter(*this, "Cleanup radius",
+        "Radius (in full-resolution pixels) of the square structuring element of the mask cleanup",
+        1,   // Initial value
+        1,   // minimum value
+        10,  // maximum value
+        false);
+
+    m_zoomedOutDisplay = createOptionParameter(*this, "Zoomed-out display",
+        "Choose whether zoomed-out views threshold the downsampled image, reduce a mask computed once at full resolution (shaded by the fraction of pixels retained, or by majority), or threshold the mean OD of the full-resolution pixels",
+        0, m_zoomedOutDisplayOptions, false);
+
+    m_reportResponse = createBoolParameter(*this, "Report threshold response",
+        "Report the retained area and integrated OD for every threshold value, from a single pass over the ROI (or display area)",
+        false, false);
+
+    m_reportIndexed = createBoolParameter(*this, "Report retained area from index",
+        "Report the retained area of the ROI (or display area) using a whole-slide index of weighted OD histograms, built once per resolution level. The threshold is rounded to the index's bins of 0.01 OD. Only available for the average and weighted OD threshold types",
+        false, false);
+
+    m_indexLevel = createIntegerParameter(*this, "Index resolution level",
+        "Resolution level of the retained area index: 0 is full resolution, each level above halves the resolution",
+        0,   // Initial value
+        0,   // minimum value
+        8,   // maximum value
+        false);
+
+    m_reportHScore = createBoolParameter(*this, "Report H-score",
+        "Report the pixel count and percentage of the weak, moderate and strong intensity bands, and the H-score, from a single full-resolution pass over the ROI (or display area)",
+        false, false);
+
+    m_reportObjects = createBoolParameter(*this, "Report objects",
+        "Report the area, centroid, bounding box and perimeter of each connected object of retained pixels in the ROI (or whole slide), from a single full-resolution pass",
+        false, false);
+
+    m_objectMinArea = createIntegerParameter(*this, "Minimum object area",
+        "Smallest object (in pixels) included in the object report",
+        1,      // Initial value
+        1,      // minimum value
+        100000, // maximum value
+        false);
+
     //GraphicItemParameter m_regionToProcess; //single output region
     m_regionToProcess = createGraphicItemParameter(*this, "Apply to ROI (None for Display Area)",
         "Choose a Region of Interest on which to apply the stain separation algorithm. Choosing no ROI will apply the stain separation to the whole slide image.",
         true); //optional. None means apply to whole slide
 
+    m_retainedSamples = createGraphicItemParameter(*this, "Color table: retained samples",
+        "Region whose colors the color classification threshold type retains. If both sample regions are chosen, the color table is trained from the colors inside their bounding rectangles instead of the threshold and hue range",
+        true);
+
+    m_rejectedSamples = createGraphicItemParameter(*this, "Color table: rejected samples",
+        "Region whose colors the color classification threshold type rejects. Used together with the retained samples",
+        true);
+
     // Bind result
     m_outputText = createTextResult(*this, "Text Result");
     m_result = createImageResult(*this, " StainAnalysisResult");
@@ -138,15 +468,39 @@ void OpticalDensityThreshold::run() {
     // Has display area changed
     bool display_changed = m_displayArea.isChanged();
 
+    //The white point and linearization change the OD of every pixel, so they are settled first
+    m_converterChanged = buildConverter();
+
     //Have any parameters been changed
     bool pipeline_changed = buildPipeline();
 
-    if (display_changed || pipeline_changed) {
-        m_result.update(m_ODThreshold_factory, m_displayArea, *this);
+    //Have the zoomed-out display pyramids been rebuilt or removed
+    bool mask_pyramid_changed = buildMaskPyramid();
+    bool od_pyramid_changed = buildODPyramid();
+
+    //Has the smoothing or mask cleanup been changed
+    bool filter_changed = m_smoothingSigma.isChanged() 
+        || m_adaptiveMethod.isChanged() || m_adaptiveRadius.isChanged() || m_adaptiveK.isChanged()
+        || m_morphology.isChanged() || m_morphologyRadius.isChanged();
+
+    //Have the report options been changed
+    bool report_changed = m_reportResponse.isChanged()
+        || m_reportIndexed.isChanged()
+        || m_indexLevel.isChanged()
+        || m_reportHScore.isChanged()
+        || m_reportObjects.isChanged()
+        || m_objectMinArea.isChanged();
+
+    if (display_changed || pipeline_changed || mask_pyramid_changed || od_pyramid_changed
+        || filter_changed || report_changed) {
+        //Zoomed-out views come from a pyramid when there is one
+        if ((false == updateZoomedOutDisplay()) && (false == updateFilteredDisplay())
+            && prefetchDisplay()) {
+            m_result.update(m_ODThreshold_factory, m_displayArea, *this);
+        }
         // Update the output text report
         if (false == askedToStop()) {
-            //auto report = generateCompleteReport();
-            //m_outputText.sendText(report);
+            updateReport();
 
             // Get image from the output factory
             auto compositor = std::make_unique<image::tile::Compositor>(m_ODThreshold_factory);
@@ -167,8 +521,11 @@ void OpticalDensityThreshold::run() {
         }
     }//if display or pipeline changed
 
-    // Ensure we run again after an abort
+    // Ensure we run again after an abort, and stop the tiles still in progress.
+    // Their Caches may hold the empty images of cancelled tiles, so they are dropped.
     if (askedToStop()) {
+        m_cancellation->Cancel();
+        m_kernelFactory.reset();
         m_ODThreshold_factory.reset();
     }
 }//end run
@@ -181,20 +538,30 @@ bool OpticalDensityThreshold::buildPipeline() {
     auto source_factory = image()->getFactory();
     auto source_color = source_factory->getColorSpace();
 
+    //The whole-slide index holds weighted OD, so it is stale once the weights or the
+    //OD conversion change, whether or not the indexed report is on
+    if (weightsChanged()) {
+        m_integralHistograms.clear();
+    }
+
     bool doProcessing = false;
     if (pipeline_changed
         || m_regionToProcess.isChanged()
         || m_threshold.isChanged()
-        || m_displayArea.isChanged()
+        || m_autoThreshold.isChanged()
+        || m_autoPercentile.isChanged()
         || m_retainment.isChanged()
-        || m_thresholdType.isChanged()
-        || m_RWeight.isChanged()
-        || m_GWeight.isChanged()
-        || m_BWeight.isChanged()
-        || (nullptr == m_ODThreshold_factory)) 
+        || weightsChanged()
+        || m_RThreshold.isChanged()
+        || m_GThreshold.isChanged()
+        || m_BThreshold.isChanged()
+        || m_outputType.isChanged()
+        || m_weakThreshold.isChanged()
+        || m_moderateThreshold.isChanged()
+        || m_strongThreshold.isChanged()
+        || m_heatmapRange.isChanged()
+        || (nullptr == m_kernelFactory)) 
     {
-        auto display_resolution = getDisplayResolution(image(), m_displayArea);
-
         //Get the Behavior value from the m_retainment
         int retainmentOptionNum = m_retainment;
         ODThresholdKernel::Behavior behaviorVal;
@@ -209,36 +576,1388 @@ bool OpticalDensityThreshold::buildPipeline() {
             behaviorVal = ODThresholdKernel::Behavior::NO_ACTION;
         }
 
+        //The Average OD type weights all channels equally
         std::array<double, 3> theWeights = { m_RWeight, m_GWeight, m_BWeight };
-        //Scale down the threshold to create more precision
-        auto threshold_kernel =
-            std::make_shared<image::tile::ODThresholdKernel>(m_threshold,
-            behaviorVal, theWeights);
+        if (0 == static_cast<int>(m_thresholdType)) {
+            theWeights = { 1.0, 1.0, 1.0 };
+        }
+        //Weight the channels by the estimated OD vector of the chosen stain
+        buildStainEstimate();
+        if ((1 == static_cast<int>(m_thresholdType)) && (nullptr != m_stainEstimate)) {
+            theWeights = getEstimatedWeights();
+        }
+        //The kernel is kept; each change publishes a new parameter snapshot, while
+        //tiles already in progress finish with the snapshot they started with
+        if (nullptr == m_ODThreshold_kernel) {
+            m_ODThreshold_kernel =
+                std::make_shared<image::tile::ODThresholdKernel>(m_threshold,
+                behaviorVal, theWeights);
+            m_ODThreshold_kernel->setBufferPool(m_bufferPool);
+        }
+        m_ODThreshold_kernel->setConverter(m_converter);
+        m_ODThreshold_kernel->setBehavior(behaviorVal);
+        m_ODThreshold_kernel->setWeights(theWeights);
+        m_ODThreshold_kernel->setThresholdType(getThresholdType());
+        m_ODThreshold_kernel->setChannelThresholds({ m_RThreshold, m_GThreshold, m_BThreshold });
+        m_ODThreshold_kernel->setStainMatrix(getStainMatrix(), m_stainToThreshold);
+        m_ODThreshold_kernel->setOutputType(getOutputType());
+        m_ODThreshold_kernel->setBands(getBandThresholds(), m_bandColors);
+        m_ODThreshold_kernel->setHeatmap(m_heatmapColors, m_heatmapRange);
 
-        // Create a Factory for the composition of these Kernels
-        auto non_cached_factory =
-            std::make_shared<FilterFactory>(source_factory, threshold_kernel);
+        //The automatic threshold comes from the weighted OD of this kernel
+        buildAutoHistogram();
+        m_ODThreshold_kernel->setODThreshold(getThresholdValue());
+        //The color table is built from the kernel's weighted OD decision
+        m_ODThreshold_kernel->setColorLUT(buildColorLUT());
 
-        // Wrap resulting Factory in a Cache for speedy results
-        m_ODThreshold_factory =
-            std::make_shared<Cache>(non_cached_factory, RecentCachePolicy(30));
+        //The setters publish a new snapshot only if a value changed. Otherwise the cached
+        //tiles are still right, so they are kept and the tiles in progress are not stopped.
+        std::uint64_t version = m_ODThreshold_kernel->getParameters()->m_version;
+        if ((nullptr == m_kernelFactory) || (version != m_kernelVersion)) {
+            //Tiles still being computed for the previous pipeline are no longer wanted
+            m_cancellation->Cancel();
+            m_ODThreshold_kernel->setCancellationToken(m_cancellation);
 
-        pipeline_changed = true;
+            // Create a Factory for the composition of these Kernels
+            auto non_cached_factory =
+                std::make_shared<FilterFactory>(source_factory, m_ODThreshold_kernel);
+
+            // Wrap resulting Factory in a Cache for speedy results
+            m_kernelFactory =
+                std::make_shared<Cache>(non_cached_factory, RecentCachePolicy(30));
+            m_kernelVersion = version;
+            pipeline_changed = true;
+        }
     }//end if parameter values changed
 
     //
     // Constrain processing to the region of interest provided, if set
-    std::shared_ptr<GraphicItemBase> region = m_regionToProcess;
-    if (pipeline_changed && (nullptr != region)) {
-        // Constrain the output of the pipeline to the region of interest provided
-        auto constrained_factory = std::make_shared<RegionFactory>(m_ODThreshold_factory, region->graphic());
+    if (pipeline_changed || m_regionToProcess.isChanged() || (nullptr == m_ODThreshold_factory)) {
+        m_ODThreshold_factory = m_kernelFactory;
+        std::shared_ptr<GraphicItemBase> region = m_regionToProcess;
+        if (nullptr != region) {
+            // Constrain the output of the pipeline to the region of interest provided
+            auto constrained_factory = std::make_shared<RegionFactory>(m_kernelFactory, region->graphic());
 
-        // Wrap resulting Factory in a Cache for speedy results
-        m_ODThreshold_factory = std::make_shared<Cache>(constrained_factory, RecentCachePolicy(30));
+            // Wrap resulting Factory in a Cache for speedy results
+            m_ODThreshold_factory = std::make_shared<Cache>(constrained_factory, RecentCachePolicy(30));
+        }
+        pipeline_changed = true;
     }
 
     return pipeline_changed;
 }//end buildPipeline
 
+bool OpticalDensityThreshold::buildMaskPyramid() {
+    //The tile summary and incremental index do not depend on the threshold value or behavior
+    if (m_regionToProcess.isChanged()) {
+        m_tileSummary.reset();
+    }
+    if (m_regionToProcess.isChanged() || weightsChanged()) {
+        m_incrementalMask.reset();
+    }
+
+    bool pyramid_existed = (nullptr != m_maskPyramid);
+    int displayOption = m_zoomedOutDisplay;
+    if ((MASK_COVERAGE != displayOption) && (MASK_MAJORITY != displayOption)) {
+        m_maskPyramid.reset();
+        return pyramid_existed;
+    }
+
+    //The pyramid does not depend on the display area, only on the threshold parameters and ROI
+    bool threshold_changed = m_threshold.isChanged() || m_retainment.isChanged()
+        || m_autoThreshold.isChanged() || m_autoPercentile.isChanged();
+    bool other_changed = m_zoomedOutDisplay.isChanged()
+        || m_regionToProcess.isChanged()
+        || weightsChanged()
+        || m_RThreshold.isChanged()
+        || m_GThreshold.isChanged()
+        || m_BThreshold.isChanged()
+        || m_smoothingSigma.isChanged()
+        || m_adaptiveMethod.isChanged()
+        || m_adaptiveRadius.isChanged()
+        || m_adaptiveK.isChanged()
+        || m_morphology.isChanged()
+        || m_morphologyRadius.isChanged();
+    if (pyramid_existed && !threshold_changed && !other_changed) {
+        return false;
+    }
+
+    //Only flip the pixels that changed state, if the pixels are indexed by OD
+    bool filtered = getMorphology().IsActive() || getSmoothing().IsActive() || getLocalThreshold().IsActive();
+    if (pyramid_existed && !other_changed && (nullptr != m_incrementalMask) && !filtered) {
+        IncrementalMask::KeyRange retainedRange = getRetainedKeyRange();
+        auto pyramid = m_maskPyramid;
+        m_incrementalMask->ForEachChangedPixel(m_incrementalMaskRange, retainedRange,
+            [&](int x, int y, int delta) { pyramid->AddPixel(x, y, delta); });
+        pyramid->Build();
+        m_incrementalMaskRange = retainedRange;
+        return true;
+    }
+    m_maskPyramid.reset();
+
+    Rect region = getProcessingRegion();
+    auto pyramid = std::make_shared<MaskPyramid>(region.width(), region.height(), m_maskPyramidMaxCells);
+
+    //A smoothed, adaptive or cleaned mask depends on the neighbors of each pixel, so tiles cannot be skipped or indexed
+    if (filtered) {
+        bool cleaned = forEachMaskTile(region,
+            [&](const Rect &tileRect, const std::vector<std::uint8_t> &mask) {
+            pyramid->AddTile(tileRect.x() - region.x(), tileRect.y() - region.y(),
+                tileRect.width(), tileRect.height(), mask);
+        });
+        if (false == cleaned) {
+            return pyramid_existed;
+        }
+        pyramid->Build();
+        m_maskPyramid = pyramid;
+        m_maskPyramidRegion = region;
+        m_incrementalMask.reset();
+        return true;
+    }
+
+    if (nullptr == m_tileSummary) {
+        m_tileSummary = std::make_shared<TileODSummary>(region.width(), region.height(), m_streamTileSize);
+    }
+    auto summary = m_tileSummary;
+
+    //Index the pixels by OD while reading them, if the region is small enough
+    std::shared_ptr<IncrementalMask> incremental = nullptr;
+    IncrementalMask::KeyRange retainedRange = getRetainedKeyRange();
+    if ((image::tile::ODThresholdKernel::WEIGHTED_OD == getThresholdType())
+        && (static_cast<long long>(region.width()) * region.height() <= m_incrementalMaskMaxPixels)) {
+        incremental = std::make_shared<IncrementalMask>(region.width(), region.height(), m_streamTileSize);
+    }
+
+    //One parameter snapshot for the whole pass, rather than a load per pixel query
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    std::vector<std::uint8_t> mask;
+    std::vector<std::uint16_t> keys;
+    bool completed = forEachSourceTile(region, 
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        std::array<int, 3> minRGB = { 255,255,255 }, maxRGB = { 0,0,0 };
+        mask.assign(numPixels, 0);
+        keys.resize(incremental ? numPixels : 0);
+        for (int px = 0; px < numPixels; px++) {
+            std::array<int, 3> rgb = pixels.GetRGB(px);
+            for (int ch = 0; ch < 3; ch++) {
+                minRGB[ch] = std::min(minRGB[ch], rgb[ch]);
+                maxRGB[ch] = std::max(maxRGB[ch], rgb[ch]);
+            }
+            if (incremental) {
+                //Decide on the quantized value, so that later incremental updates agree
+                int key = IncrementalMask::QuantizeOD(parameters->weightedOD(rgb));
+                keys[px] = static_cast<std::uint16_t>(key);
+                mask[px] = ((key >= retainedRange.first) && (key < retainedRange.second)) ? 1 : 0;
+            }
+            else {
+                mask[px] = parameters->isRetained(rgb) ? 1 : 0;
+            }
+        }
+        int x = tileRect.x() - region.x(), y = tileRect.y() - region.y();
+        summary->SetTile(summary->GetTileColumn(x), summary->GetTileRow(y), minRGB, maxRGB);
+        pyramid->AddTile(x, y, tileRect.width(), tileRect.height(), mask);
+        if (incremental) {
+            incremental->SetTile(x, y, tileRect.width(), tileRect.height(), keys);
+        }
+    },
+        [&](const Rect &tileRect) {
+        //Every tile must be read to index it
+        if (incremental) {
+            return false;
+        }
+        //Tiles entirely on one side of the threshold are added without reading their pixels
+        int x = tileRect.x() - region.x(), y = tileRect.y() - region.y();
+        int column = summary->GetTileColumn(x), row = summary->GetTileRow(y);
+        bool retained = false;
+        if (summary->HasTile(column, row) && parameters->isUniformRange(
+            summary->GetMinRGB(column, row), summary->GetMaxRGB(column, row), retained)) {
+            pyramid->AddUniformTile(x, y, tileRect.width(), tileRect.height(), retained);
+            return true;
+        }
+        return false;
+    });
+    //Leave the pyramid empty if processing was stopped; it is rebuilt on the next run
+    if (false == completed) {
+        return pyramid_existed;
+    }
+
+    pyramid->Build();
+    m_maskPyramid = pyramid;
+    m_maskPyramidRegion = region;
+    m_incrementalMask = incremental;
+    m_incrementalMaskRange = retainedRange;
+    return true;
+}//end buildMaskPyramid
+
+image::tile::ODThresholdKernel::ThresholdType OpticalDensityThreshold::getThresholdType() {
+    int thresholdTypeOptionNum = m_thresholdType;
+    if (2 == thresholdTypeOptionNum) {
+        return image::tile::ODThresholdKernel::PER_CHANNEL_ANY;
+    }
+    else if (3 == thresholdTypeOptionNum) {
+        return image::tile::ODThresholdKernel::PER_CHANNEL_ALL;
+    }
+    else if (4 == thresholdTypeOptionNum) {
+        return image::tile::ODThresholdKernel::STAIN_DECONVOLUTION;
+    }
+    else if (5 == thresholdTypeOptionNum) {
+        return image::tile::ODThresholdKernel::COLOR_LUT;
+    }
+    //Average and weighted average OD
+    return image::tile::ODThresholdKernel::WEIGHTED_OD;
+}//end getThresholdType
+
+image::tile::ODThresholdKernel::OutputType OpticalDensityThreshold::getOutputType() {
+    int outputTypeOptionNum = m_outputType;
+    if (1 == outputTypeOptionNum) {
+        return image::tile::ODThresholdKernel::LABEL_MAP;
+    }
+    else if (2 == outputTypeOptionNum) {
+        return image::tile::ODThresholdKernel::HEATMAP;
+    }
+    else if (3 == outputTypeOptionNum) {
+        return image::tile::ODThresholdKernel::ALPHA_MASK;
+    }
+    return image::tile::ODThresholdKernel::RETAINED_COLOR;
+}//end getOutputType
+
+bool OpticalDensityThreshold::isMaskOutput() {
+    image::tile::ODThresholdKernel::OutputType outputType = getOutputType();
+    return (image::tile::ODThresholdKernel::RETAINED_COLOR == outputType)
+        || (image::tile::ODThresholdKernel::ALPHA_MASK == outputType);
+}//end isMaskOutput
+
+void OpticalDensityThreshold::setMaskPixel(RawImage &output, int px, 
+    const std::array<int, 3> &rgb, double coverage, bool alphaMask) {
+    int outputScaleMax = sedeen::maxChannelValue<int>(output.colorSpace());
+    int numOutputChannels = static_cast<int>(channels(output));
+    //The alpha mask keeps the source color and carries the coverage in alpha;
+    //otherwise the color is shaded by the coverage and the pixel is opaque
+    for (int ch = 0; ch < 3; ch++) {
+        output.setValue(px*numOutputChannels + ch, alphaMask ? rgb[ch] 
+            : static_cast<int>(std::round(coverage * rgb[ch])));
+    }
+    output.setValue(px*numOutputChannels + 3, alphaMask 
+        ? static_cast<int>(std::round(coverage * outputScaleMax)) : outputScaleMax);
+}//end setMaskPixel
+
+std::vector<std::array<int, 3>> OpticalDensityThreshold::getHeatmapColors() {
+    //256 colors interpolated between blue, cyan, green, yellow and red
+    const std::array<std::array<double, 3>, 5> stops = { {
+        {{ 0,0,255 }}, {{ 0,255,255 }}, {{ 0,255,0 }}, {{ 255,255,0 }}, {{ 255,0,0 }} } };
+    std::vector<std::array<int, 3>> colors(256);
+    for (int i = 0; i < 256; i++) {
+        double position = i / 255.0 * (stops.size() - 1);
+        int stop = std::min(static_cast<int>(position), static_cast<int>(stops.size()) - 2);
+        double t = position - stop;
+        for (int ch = 0; ch < 3; ch++) {
+            colors[i][ch] = static_cast<int>(std::round((1.0 - t) * stops[stop][ch] + t * stops[stop + 1][ch]));
+        }
+    }
+    return colors;
+}//end getHeatmapColors
+
+StainMatrix OpticalDensityThreshold::getStainMatrix() {
+    if (nullptr != m_stainEstimate) {
+        return *m_stainEstimate;
+    }
+    int stainMatrixOptionNum = m_stainMatrix;
+    if (1 == stainMatrixOptionNum) {
+        return StainMatrix(StainMatrix::Hematoxylin(), StainMatrix::DAB());
+    }
+    else if (2 == stainMatrixOptionNum) {
+        return StainMatrix(StainMatrix::Hematoxylin(), StainMatrix::Eosin(), StainMatrix::DAB());
+    }
+    //Hematoxylin and eosin, with the third stain orthogonal to both
+    return StainMatrix(StainMatrix::Hematoxylin(), StainMatrix::Eosin());
+}//end getStainMatrix
+
+bool OpticalDensityThreshold::buildAutoHistogram() {
+    image::tile::ODThresholdKernel::ThresholdType thresholdType = getThresholdType();
+    if ((0 == static_cast<int>(m_autoThreshold))
+        || ((image::tile::ODThresholdKernel::WEIGHTED_OD != thresholdType)
+        && (image::tile::ODThresholdKernel::STAIN_DECONVOLUTION != thresholdType)
+        && (image::tile::ODThresholdKernel::COLOR_LUT != thresholdType))) {
+        m_autoHistogram.reset();
+        return false;
+    }
+    //The histogram does not depend on the threshold value, behavior or method
+    if ((nullptr != m_autoHistogram)
+        && !m_regionToProcess.isChanged()
+        && !weightsChanged()) {
+        return false;
+    }
+    m_autoHistogram.reset();
+
+    //Read the lowest resolution at which the region still has m_autoHistogramMaxPixels pixels
+    Rect region = getProcessingRegion();
+    int downsample = 1;
+    while (static_cast<double>(region.width() / downsample) * (region.height() / downsample) 
+        > m_autoHistogramMaxPixels) {
+        downsample *= 2;
+    }
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    auto histogram = std::make_shared<ODHistogram>(m_thresholdMaxVal, m_responseHistogramBins);
+    bool completed = forEachSourceTile(region,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            histogram->Add(parameters->weightedOD(pixels.GetRGB(px)));
+        }
+    }, nullptr, downsample);
+    if (false == completed) {
+        return false;
+    }
+    m_autoHistogram = histogram;
+    return true;
+}//end buildAutoHistogram
+
+double OpticalDensityThreshold::getThresholdValue() {
+    if (nullptr == m_autoHistogram) {
+        return m_threshold;
+    }
+    int autoOptionNum = m_autoThreshold;
+    if (1 == autoOptionNum) {
+        m_autoThresholdValue = m_autoHistogram->GetOtsuThreshold();
+    }
+    else if (2 == autoOptionNum) {
+        m_autoThresholdValue = m_autoHistogram->GetTriangleThreshold();
+    }
+    else if (3 == autoOptionNum) {
+        m_autoThresholdValue = m_autoHistogram->GetPercentileThreshold(m_autoPercentile);
+    }
+    else {
+        return m_threshold;
+    }
+    return m_autoThresholdValue;
+}//end getThresholdValue
+
+std::string OpticalDensityThreshold::generateAutoThresholdReport() {
+    std::ostringstream ss;
+    if (nullptr == m_autoHistogram) {
+        return ss.str();
+    }
+    double threshold = getThresholdValue();
+    ss << "Automatic threshold (" << m_autoThresholdOptions.at(static_cast<int>(m_autoThreshold)) << "): "
+        << std::fixed << std::setprecision(3) << threshold << std::endl;
+    return ss.str();
+}//end generateAutoThresholdReport
+
+bool OpticalDensityThreshold::weightsChanged() {
+    return m_thresholdType.isChanged()
+        || m_RWeight.isChanged()
+        || m_GWeight.isChanged()
+        || m_BWeight.isChanged()
+        || m_stainMatrix.isChanged()
+        || m_stainToThreshold.isChanged()
+        || m_estimateStains.isChanged()
+        || (m_estimateStains && m_regionToProcess.isChanged())
+        || m_converterChanged
+        || ((image::tile::ODThresholdKernel::COLOR_LUT == getThresholdType())
+        && (m_hueMin.isChanged() || m_hueMax.isChanged()
+        || m_retainedSamples.isChanged() || m_rejectedSamples.isChanged()));
+}//end weightsChanged
+
+std::shared_ptr<ColorLUT> OpticalDensityThreshold::buildColorLUT() {
+    if (image::tile::ODThresholdKernel::COLOR_LUT != getThresholdType()) {
+        m_colorLUT.reset();
+        m_colorLUTKey.clear();
+        return m_colorLUT;
+    }
+    std::shared_ptr<GraphicItemBase> retainedRegion = m_retainedSamples;
+    std::shared_ptr<GraphicItemBase> rejectedRegion = m_rejectedSamples;
+    if ((nullptr != retainedRegion) && (nullptr != rejectedRegion)) {
+        //Train on the sample colors; the table then does not depend on the threshold or hue range
+        Rect retainedRect = containingRect(retainedRegion->graphic());
+        Rect rejectedRect = containingRect(rejectedRegion->graphic());
+        std::vector<double> key = { -1.0,
+            static_cast<double>(retainedRect.x()), static_cast<double>(retainedRect.y()),
+            static_cast<double>(retainedRect.width()), static_cast<double>(retainedRect.height()),
+            static_cast<double>(rejectedRect.x()), static_cast<double>(rejectedRect.y()),
+            static_cast<double>(rejectedRect.width()), static_cast<double>(rejectedRect.height()) };
+        if ((nullptr != m_colorLUT) && (key == m_colorLUTKey)) {
+            return m_colorLUT;
+        }
+        std::vector<std::array<int, 3>> retained, rejected;
+        if ((false == sampleColors(retainedRect, retained)) || (false == sampleColors(rejectedRect, rejected))) {
+            //Stopped: keep the previous table, and retrain on the next run
+            m_colorLUTKey.clear();
+            return m_colorLUT;
+        }
+        auto lut = std::make_shared<ColorLUT>();
+        lut->Train(retained, rejected);
+        m_colorLUT = lut;
+        m_colorLUTKey = key;
+        return m_colorLUT;
+    }
+
+    //Retain pixels whose weighted OD passes the threshold and whose hue is in the range
+    double hueMin = m_hueMin, hueMax = m_hueMax;
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    //Building takes seconds, so the table is kept until an input of the rule changes
+    std::vector<double> key = { parameters->m_odThreshVal, static_cast<double>(parameters->m_behavior),
+        parameters->m_projection[0], parameters->m_projection[1], parameters->m_projection[2],
+        hueMin, hueMax };
+    if ((nullptr != m_colorLUT) && (key == m_colorLUTKey) && (false == m_converterChanged)) {
+        return m_colorLUT;
+    }
+    auto lut = std::make_shared<ColorLUT>();
+    lut->Build([&](int r, int g, int b) {
+        if (false == parameters->isRetained(parameters->weightedOD(std::array<int, 3>{ r, g, b }))) {
+            return false;
+        }
+        double hue = getHue(r, g, b);
+        return (hueMin <= hueMax) ? ((hue >= hueMin) && (hue <= hueMax))
+            : ((hue >= hueMin) || (hue <= hueMax));
+    });
+    m_colorLUT = lut;
+    m_colorLUTKey = key;
+    return m_colorLUT;
+}//end buildColorLUT
+
+bool OpticalDensityThreshold::sampleColors(const Rect &region, std::vector<std::array<int, 3>> &colors) {
+    int downsample = 1;
+    while (static_cast<double>(region.width() / downsample) * (region.height() / downsample) 
+        > m_stainEstimateMaxPixels) {
+        downsample *= 2;
+    }
+    return forEachSourceTile(region,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            colors.push_back(pixels.GetRGB(px));
+        }
+    }, nullptr, downsample);
+}//end sampleColors
+
+double OpticalDensityThreshold::getHue(int r, int g, int b) {
+    int maxValue = std::max(r, std::max(g, b));
+    int minValue = std::min(r, std::min(g, b));
+    double chroma = static_cast<double>(maxValue - minValue);
+    //Gray pixels have no hue; they are given 0 (red)
+    if (0.0 == chroma) {
+        return 0.0;
+    }
+    double hue;
+    if (maxValue == r) {
+        hue = std::fmod((g - b) / chroma + 6.0, 6.0);
+    }
+    else if (maxValue == g) {
+        hue = (b - r) / chroma + 2.0;
+    }
+    else {
+        hue = (r - g) / chroma + 4.0;
+    }
+    return 60.0 * hue;
+}//end getHue
+
+bool OpticalDensityThreshold::buildWhitePoint() {
+    if (false == static_cast<bool>(m_estimateWhitePoint)) {
+        bool was_sampled = m_whitePointSampled;
+        m_whitePointSampled = false;
+        m_whitePoint = ODConversion::GetDefaultWhitePoint();
+        return was_sampled;
+    }
+    //The background belongs to the slide, not the ROI, so it is sampled once
+    if (m_whitePointSampled) {
+        return false;
+    }
+
+    //Sample the lowest resolution at which the slide still has m_stainEstimateMaxPixels pixels
+    Rect slide(Point(0, 0), image::getDimensions(image(), 0));
+    int downsample = 1;
+    while (static_cast<double>(slide.width() / downsample) * (slide.height() / downsample) 
+        > m_stainEstimateMaxPixels) {
+        downsample *= 2;
+    }
+    WhitePointEstimator estimator(ODConversion::GetRGBMaxValue());
+    bool completed = forEachSourceTile(slide,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            estimator.Add(pixels.GetRGB(px));
+        }
+    }, nullptr, downsample);
+    if (false == completed) {
+        return false;
+    }
+    //Keep the default white point if the slide has no background
+    std::array<double, 3> whitePoint = ODConversion::GetDefaultWhitePoint();
+    estimator.Estimate(whitePoint);
+    m_whitePoint = whitePoint;
+    m_whitePointSampled = true;
+    return true;
+}//end buildWhitePoint
+
+bool OpticalDensityThreshold::buildConverter() {
+    bool white_point_changed = buildWhitePoint();
+    bool curve_changed = m_linearization.isChanged() 
+        || (m_gamma.isChanged() && (GAMMA_CURVE == static_cast<int>(m_linearization)));
+    if (!white_point_changed && !curve_changed) {
+        return false;
+    }
+    //Fold the curves into the per-channel OD tables
+    ODConversion::Curve curve;
+    int linearizationOption = m_linearization;
+    if (SRGB_CURVE == linearizationOption) {
+        curve = ODConversion::SRGBCurve();
+    }
+    else if (GAMMA_CURVE == linearizationOption) {
+        curve = ODConversion::GammaCurve(m_gamma);
+    }
+    m_converter = ODConversion(m_whitePoint, { curve, curve, curve });
+    return true;
+}//end buildConverter
+
+bool OpticalDensityThreshold::buildStainEstimate() {
+    if (false == static_cast<bool>(m_estimateStains)) {
+        m_stainEstimate.reset();
+        return false;
+    }
+    if ((nullptr != m_stainEstimate) && !m_regionToProcess.isChanged() && !m_estimateStains.isChanged()
+        && !m_converterChanged) {
+        return false;
+    }
+    m_stainEstimate.reset();
+
+    //Sample the lowest resolution at which the region still has m_stainEstimateMaxPixels pixels
+    Rect region = getProcessingRegion();
+    int downsample = 1;
+    while (static_cast<double>(region.width() / downsample) * (region.height() / downsample) 
+        > m_stainEstimateMaxPixels) {
+        downsample *= 2;
+    }
+    StainEstimator estimator;
+    bool completed = forEachSourceTile(region,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            std::array<int, 3> rgb = pixels.GetRGB(px);
+            estimator.Add({ m_converter.LookupRGBtoOD(rgb[0], 0), m_converter.LookupRGBtoOD(rgb[1], 1), 
+                m_converter.LookupRGBtoOD(rgb[2], 2) });
+        }
+    }, nullptr, downsample);
+    StainMatrix::Vector stain1, stain2;
+    if ((false == completed) || (false == estimator.Estimate(stain1, stain2))) {
+        return false;
+    }
+    m_stainEstimate = std::make_shared<StainMatrix>(stain1, stain2);
+    return true;
+}//end buildStainEstimate
+
+std::array<double, 3> OpticalDensityThreshold::getEstimatedWeights() {
+    //Weights cannot be negative
+    const StainMatrix::Vector &stain = m_stainEstimate->GetStain(m_stainToThreshold);
+    return { std::max(0.0, stain[0]), std::max(0.0, stain[1]), std::max(0.0, stain[2]) };
+}//end getEstimatedWeights
+
+std::string OpticalDensityThreshold::generateStainEstimateReport() {
+    std::ostringstream ss;
+    if (m_estimateWhitePoint && m_whitePointSampled) {
+        const std::array<double, 3> &whitePoint = m_whitePoint;
+        ss << std::fixed << std::setprecision(1) << "Estimated white point (I0): " 
+            << whitePoint[0] << ", " << whitePoint[1] << ", " << whitePoint[2] << std::endl;
+    }
+    if (false == static_cast<bool>(m_estimateStains)) {
+        return ss.str();
+    }
+    if (nullptr == m_stainEstimate) {
+        ss << "Stain estimate: too few stained pixels" << std::endl;
+        return ss.str();
+    }
+    ss << std::fixed << std::setprecision(3);
+    for (int stain = 0; stain < 3; stain++) {
+        const StainMatrix::Vector &v = m_stainEstimate->GetStain(stain);
+        ss << "Estimated stain " << stain + 1 << " OD vector: " 
+            << v[0] << ", " << v[1] << ", " << v[2] << std::endl;
+    }
+    if (1 == static_cast<int>(m_thresholdType)) {
+        std::array<double, 3> w = getEstimatedWeights();
+        ss << "Estimated weights: " << w[0] << ", " << w[1] << ", " << w[2] << std::endl;
+    }
+    return ss.str();
+}//end generateStainEstimateReport
+
+IncrementalMask::KeyRange OpticalDensityThreshold::getRetainedKeyRange() {
+    int retainment = m_retainment;
+    if (image::tile::ODThresholdKernel::Behavior::RETAIN_HIGHER_OD == retainment) {
+        return IncrementalMask::GetRetainedRange(getThresholdValue(), true);
+    }
+    else if (image::tile::ODThresholdKernel::Behavior::RETAIN_LOWER_OD == retainment) {
+        return IncrementalMask::GetRetainedRange(getThresholdValue(), false);
+    }
+    return IncrementalMask::KeyRange(0, 0);
+}//end getRetainedKeyRange
+
+bool OpticalDensityThreshold::buildODPyramid() {
+    bool pyramid_existed = (nullptr != m_ODPyramid);
+    int displayOption = m_zoomedOutDisplay;
+    if (MEAN_OD_PYRAMID != displayOption) {
+        m_ODPyramid.reset();
+        return pyramid_existed;
+    }
+
+    //The mean OD does not depend on the threshold parameters, only on the ROI and white point
+    if (pyramid_existed && !m_regionToProcess.isChanged() && !m_converterChanged) {
+        return false;
+    }
+    m_ODPyramid.reset();
+
+    Rect region = getProcessingRegion();
+    auto pyramid = std::make_shared<ODPyramid>(region.width(), region.height(), 
+        m_maskPyramidMaxCells, m_converter);
+    bool completed = forEachSourceTile(region,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int x0 = tileRect.x() - region.x();
+        int y0 = tileRect.y() - region.y();
+        for (int y = 0; y < tileRect.height(); y++) {
+            for (int x = 0; x < tileRect.width(); x++) {
+                pyramid->AddPixel(x0 + x, y0 + y, pixels.GetRGB(y * tileRect.width() + x));
+            }
+        }
+    });
+    //Leave the pyramid empty if processing was stopped; it is rebuilt on the next run
+    if (false == completed) {
+        return pyramid_existed;
+    }
+
+    pyramid->Build();
+    m_ODPyramid = pyramid;
+    m_ODPyramidRegion = region;
+    return true;
+}//end buildODPyramid
+
+bool OpticalDensityThreshold::updateZoomedOutDisplay() {
+    //The pyramids hold retained pixels, not intensity bands
+    if (false == isMaskOutput()) {
+        return false;
+    }
+    DisplayRegion region = m_displayArea;
+    if ((region.output_size.width() <= 0) || (region.output_size.height() <= 0)) {
+        return false;
+    }
+    //Closer views are thresholded by the pipeline at (or near) full resolution
+    double downsample = static_cast<double>(region.source_region.width()) 
+        / static_cast<double>(region.output_size.width());
+
+    if (nullptr != m_maskPyramid) {
+        int level = m_maskPyramid->SelectLevel(downsample);
+        if (level < 0) {
+            return false;
+        }
+        MaskPyramid::Reduction reduction = (MASK_COVERAGE == static_cast<int>(m_zoomedOutDisplay))
+            ? MaskPyramid::COVERAGE : MaskPyramid::MAJORITY;
+        return updateFromPyramidCells(m_maskPyramidRegion, m_maskPyramid->GetLevelFactor(level),
+            m_maskPyramid->GetLevelWidth(level), m_maskPyramid->GetLevelHeight(level),
+            [&](int cx, int cy) { return m_maskPyramid->GetValue(level, cx, cy, reduction); });
+    }
+    else if (nullptr != m_ODPyramid) {
+        int level = m_ODPyramid->SelectLevel(downsample);
+        if (level < 0) {
+            return false;
+        }
+        auto parameters = m_ODThreshold_kernel->getParameters();
+        return updateFromPyramidCells(m_ODPyramidRegion, m_ODPyramid->GetLevelFactor(level),
+            m_ODPyramid->GetLevelWidth(level), m_ODPyramid->GetLevelHeight(level),
+            [&](int cx, int cy) {
+            return parameters->isRetainedOD(m_ODPyramid->GetMeanOD(level, cx, cy)) ? 1.0 : 0.0;
+        });
+    }
+    return false;
+}//end updateZoomedOutDisplay
+
+bool OpticalDensityThreshold::prefetchDisplay() {
+    //Compute the display tiles on a worker, so this thread can watch for a stop request
+    DisplayRegion region = m_displayArea;
+    std::shared_ptr<image::tile::Factory> factory = m_ODThreshold_factory;
+    auto prefetch = std::async(std::launch::async, [factory, region]() {
+        auto compositor = std::make_unique<image::tile::Compositor>(factory);
+        compositor->getImage(region.source_region, region.output_size);
+    });
+    while (std::future_status::ready != prefetch.wait_for(std::chrono::milliseconds(m_stopPollInterval))) {
+        if (askedToStop()) {
+            //The tiles in progress return within a few rows
+            m_cancellation->Cancel();
+            prefetch.wait();
+            break;
+        }
+    }
+    prefetch.get();
+    return (false == askedToStop());
+}//end prefetchDisplay
+
+bool OpticalDensityThreshold::updateFilteredDisplay() {
+    //Intensity bands are not a binary mask
+    if (false == isMaskOutput()) {
+        return false;
+    }
+    DisplayRegion region = m_displayArea;
+    if ((region.output_size.width() <= 0) || (region.output_size.height() <= 0)) {
+        return false;
+    }
+    double downsample = static_cast<double>(region.source_region.width()) 
+        / static_cast<double>(region.output_size.width());
+    //Scale the blur and structuring element to display pixels, so the view matches full resolution.
+    //If they are smaller than a display pixel, they are not visible.
+    int morphologyOptionNum = m_morphology;
+    int radius = static_cast<int>(std::round(m_morphologyRadius / downsample));
+    MaskMorphology morphology(static_cast<MaskMorphology::Operation>(morphologyOptionNum), radius);
+    GaussianSmoothing smoothing(m_smoothingSigma / downsample);
+    //The adaptive window is kept at least one display pixel, because it replaces the global threshold
+    LocalThreshold fullLocal = getLocalThreshold();
+    int adaptiveOptionNum = m_adaptiveMethod;
+    LocalThreshold local(fullLocal.IsActive() ? static_cast<LocalThreshold::Method>(adaptiveOptionNum) : LocalThreshold::NONE,
+        std::max(1, static_cast<int>(std::round(m_adaptiveRadius / downsample))), m_adaptiveK, m_sauvolaRange);
+    if ((false == morphology.IsActive()) && (false == smoothing.IsActive()) && (false == local.IsActive())) {
+        return false;
+    }
+
+    //Read the display area of the processing region with a halo
+    Rect processingRegion = getProcessingRegion();
+    int halo = static_cast<int>(std::ceil((morphology.GetHalo() + smoothing.GetRadius() + local.GetRadius()) * downsample));
+    int x0 = std::max(processingRegion.x(), region.source_region.x() - halo);
+    int y0 = std::max(processingRegion.y(), region.source_region.y() - halo);
+    int x1 = std::min(processingRegion.x() + processingRegion.width(),
+        region.source_region.x() + region.source_region.width() + halo);
+    int y1 = std::min(processingRegion.y() + processingRegion.height(),
+        region.source_region.y() + region.source_region.height() + halo);
+    if ((x1 <= x0) || (y1 <= y0)) {
+        return false;
+    }
+    Rect expandedRect(Point(x0, y0), Size(x1 - x0, y1 - y0));
+    Size expandedSize(std::max(1, static_cast<int>(std::round((x1 - x0) / downsample))),
+        std::max(1, static_cast<int>(std::round((y1 - y0) / downsample))));
+    auto compositor = std::make_unique<image::tile::Compositor>(image()->getFactory());
+    RawImage source = compositor->getImage(expandedRect, expandedSize);
+    image::PixelAccessor sourcePixels(source);
+    int numPixels = sourcePixels.GetNumPixels();
+
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    std::vector<std::uint8_t> mask(numPixels);
+    if (smoothing.IsActive() || local.IsActive()) {
+        std::vector<GaussianSmoothing::ODPixel> od(numPixels);
+        for (int px = 0; px < numPixels; px++) {
+            od[px] = toODPixel(m_converter, sourcePixels.GetRGB(px));
+        }
+        smoothing.Apply(od, expandedSize.width(), expandedSize.height());
+        thresholdOD(od, expandedSize.width(), expandedSize.height(), local, mask);
+    }
+    else {
+        for (int px = 0; px < numPixels; px++) {
+            mask[px] = parameters->isRetained(sourcePixels.GetRGB(px)) ? 1 : 0;
+        }
+    }
+    morphology.Apply(mask, expandedSize.width(), expandedSize.height());
+
+    ColorSpace outputColor(ColorModel::RGBA, ChannelType::UInt8);
+    RawImage output(expandedSize, outputColor, PixelOrder::Interleaved);
+    bool alphaMask = (image::tile::ODThresholdKernel::ALPHA_MASK == getOutputType());
+    for (int px = 0; px < numPixels; px++) {
+        setMaskPixel(output, px, sourcePixels.GetRGB(px), mask[px] ? 1.0 : 0.0, alphaMask);
+    }
+
+    m_result.update(output, expandedRect);
+    return true;
+}//end updateFilteredDisplay
+
+MaskMorphology OpticalDensityThreshold::getMorphology() {
+    int morphologyOptionNum = m_morphology;
+    return MaskMorphology(static_cast<MaskMorphology::Operation>(morphologyOptionNum), m_morphologyRadius);
+}//end getMorphology
+
+GaussianSmoothing OpticalDensityThreshold::getSmoothing() {
+    return GaussianSmoothing(m_smoothingSigma);
+}//end getSmoothing
+
+LocalThreshold OpticalDensityThreshold::getLocalThreshold() {
+    //The local statistics are of a single OD value per pixel
+    image::tile::ODThresholdKernel::ThresholdType thresholdType = getThresholdType();
+    int adaptiveOptionNum = m_adaptiveMethod;
+    if ((image::tile::ODThresholdKernel::WEIGHTED_OD != thresholdType)
+        && (image::tile::ODThresholdKernel::STAIN_DECONVOLUTION != thresholdType)) {
+        adaptiveOptionNum = LocalThreshold::NONE;
+    }
+    return LocalThreshold(static_cast<LocalThreshold::Method>(adaptiveOptionNum), 
+        m_adaptiveRadius, m_adaptiveK, m_sauvolaRange);
+}//end getLocalThreshold
+
+void OpticalDensityThreshold::thresholdOD(const std::vector<GaussianSmoothing::ODPixel> &od,
+    int width, int height, const LocalThreshold &local, std::vector<std::uint8_t> &mask) {
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    if (false == local.IsActive()) {
+        mask.resize(od.size());
+        for (std::size_t px = 0; px < od.size(); px++) {
+            mask[px] = parameters->isRetainedOD({ od[px][0], od[px][1], od[px][2] }) ? 1 : 0;
+        }
+        return;
+    }
+    std::vector<float> weighted(od.size());
+    for (std::size_t px = 0; px < od.size(); px++) {
+        weighted[px] = static_cast<float>(parameters->weightedOD(
+            std::array<double, 3>{ od[px][0], od[px][1], od[px][2] }));
+    }
+    bool retainHigher = (image::tile::ODThresholdKernel::Behavior::RETAIN_HIGHER_OD == static_cast<int>(m_retainment));
+    local.Apply(weighted, width, height, retainHigher, mask);
+}//end thresholdOD
+
+GaussianSmoothing::ODPixel OpticalDensityThreshold::toODPixel(const ODConversion &converter,
+    const std::array<int, 3> &rgb) {
+    return { static_cast<float>(converter.LookupRGBtoOD(rgb[0], 0)),
+        static_cast<float>(converter.LookupRGBtoOD(rgb[1], 1)),
+        static_cast<float>(converter.LookupRGBtoOD(rgb[2], 2)) };
+}//end toODPixel
+
+bool OpticalDensityThreshold::updateFromPyramidCells(const Rect &pyramidRegion, int factor,
+    int levelWidth, int levelHeight, const std::function<double(int, int)> &cellValue) {
+    DisplayRegion region = m_displayArea;
+
+    //Find the cells of the level that intersect the display area
+    int left = region.source_region.x() - pyramidRegion.x();
+    int top = region.source_region.y() - pyramidRegion.y();
+    int cx0 = std::max(0, left) / factor;
+    int cy0 = std::max(0, top) / factor;
+    int cx1 = std::min(levelWidth, 
+        (std::max(0, left + region.source_region.width()) + factor - 1) / factor);
+    int cy1 = std::min(levelHeight,
+        (std::max(0, top + region.source_region.height()) + factor - 1) / factor);
+    if ((cx1 <= cx0) || (cy1 <= cy0)) {
+        return false;
+    }
+
+    int x0 = pyramidRegion.x() + cx0 * factor;
+    int y0 = pyramidRegion.y() + cy0 * factor;
+    Rect cellsRect(Point(x0, y0), 
+        Size(std::min(pyramidRegion.x() + pyramidRegion.width(), pyramidRegion.x() + cx1 * factor) - x0,
+             std::min(pyramidRegion.y() + pyramidRegion.height(), pyramidRegion.y() + cy1 * factor) - y0));
+    Size outputSize(cx1 - cx0, cy1 - cy0);
+
+    //Shade the downsampled source by the cell values
+    auto compositor = std::make_unique<image::tile::Compositor>(image()->getFactory());
+    RawImage source = compositor->getImage(cellsRect, outputSize);
+    image::PixelAccessor sourcePixels(source);
+
+    ColorSpace outputColor(ColorModel::RGBA, ChannelType::UInt8);
+    RawImage output(outputSize, outputColor, PixelOrder::Interleaved);
+    bool alphaMask = (image::tile::ODThresholdKernel::ALPHA_MASK == getOutputType());
+    for (int cy = cy0; cy < cy1; cy++) {
+        for (int cx = cx0; cx < cx1; cx++) {
+            int px = (cy - cy0) * outputSize.width() + (cx - cx0);
+            setMaskPixel(output, px, sourcePixels.GetRGB(px), cellValue(cx, cy), alphaMask);
+        }
+    }
+
+    m_result.update(output, cellsRect);
+    return true;
+}//end updateFromPyramidCells
+
+bool OpticalDensityThreshold::forEachMaskTile(const Rect &region,
+    const std::function<void(const Rect&, const std::vector<std::uint8_t>&)> &visitor) {
+    MaskMorphology morphology = getMorphology();
+    GaussianSmoothing smoothing = getSmoothing();
+    LocalThreshold local = getLocalThreshold();
+    //The stream keeps at most half a tile of halo, so wider neighborhoods (e.g. a large
+    //adaptive window) are streamed in larger tiles rather than truncated at the tile edge
+    int halo = morphology.GetHalo() + smoothing.GetRadius() + local.GetRadius();
+    int tileSize = std::max(m_streamTileSize, 2 * halo);
+    bool filterOD = smoothing.IsActive() || local.IsActive();
+    auto compositor = std::make_unique<image::tile::Compositor>(image()->getFactory());
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    //Threshold the pixels that the stream has not read before
+    auto fetchMask = [&](int x, int y, int w, int h, std::vector<std::uint8_t> &mask) {
+        RawImage tile = compositor->getImage(Rect(Point(region.x() + x, region.y() + y), Size(w, h)), Size(w, h));
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        mask.resize(numPixels);
+        for (int px = 0; px < numPixels; px++) {
+            mask[px] = parameters->isRetained(pixels.GetRGB(px)) ? 1 : 0;
+        }
+    };
+    //Or convert them to OD, to be smoothed or thresholded by their neighborhood
+    auto fetchOD = [&](int x, int y, int w, int h, std::vector<GaussianSmoothing::ODPixel> &od) {
+        RawImage tile = compositor->getImage(Rect(Point(region.x() + x, region.y() + y), Size(w, h)), Size(w, h));
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        od.resize(numPixels);
+        for (int px = 0; px < numPixels; px++) {
+            od[px] = toODPixel(m_converter, pixels.GetRGB(px));
+        }
+    };
+    //Only the stream that is read is built
+    std::unique_ptr<HaloTileStream<std::uint8_t>> maskStream;
+    std::unique_ptr<HaloTileStream<GaussianSmoothing::ODPixel>> ODStream;
+    if (filterOD) {
+        ODStream = std::make_unique<HaloTileStream<GaussianSmoothing::ODPixel>>(region.width(), region.height(), halo);
+    }
+    else {
+        maskStream = std::make_unique<HaloTileStream<std::uint8_t>>(region.width(), region.height(), halo);
+    }
+    std::vector<GaussianSmoothing::ODPixel> expandedOD;
+    std::vector<std::uint8_t> expanded, mask;
+    for (int y = 0; y < region.height(); y += tileSize) {
+        for (int x = 0; x < region.width(); x += tileSize) {
+            if (askedToStop()) {
+                return false;
+            }
+            int w = std::min(tileSize, region.width() - x);
+            int h = std::min(tileSize, region.height() - y);
+            int ex = 0, ey = 0, ew = 0, eh = 0;
+            if (filterOD) {
+                ODStream->GetTile(x, y, w, h, fetchOD, expandedOD, ex, ey, ew, eh);
+                smoothing.Apply(expandedOD, ew, eh);
+                thresholdOD(expandedOD, ew, eh, local, expanded);
+            }
+            else {
+                maskStream->GetTile(x, y, w, h, fetchMask, expanded, ex, ey, ew, eh);
+            }
+            morphology.Apply(expanded, ew, eh);
+            //Keep the tile, without its halo
+            mask.resize(static_cast<std::size_t>(w) * h);
+            for (int row = 0; row < h; row++) {
+                auto first = expanded.begin() + (y - ey + row) * ew + (x - ex);
+                std::copy(first, first + w, mask.begin() + row * w);
+            }
+            visitor(Rect(Point(region.x() + x, region.y() + y), Size(w, h)), mask);
+        }
+    }
+    return true;
+}//end forEachMaskTile
+
+bool OpticalDensityThreshold::forEachSourceTile(const Rect &region,
+    const std::function<void(const Rect&, const RawImage&)> &visitor,
+    const std::function<bool(const Rect&)> &skipTile /*= nullptr*/,
+    int downsample /*= 1*/) {
+    auto compositor = std::make_unique<image::tile::Compositor>(image()->getFactory());
+    //Tiles are m_streamTileSize pixels across after downsampling
+    int step = m_streamTileSize * downsample;
+    int xEnd = region.x() + region.width();
+    int yEnd = region.y() + region.height();
+    for (int y = region.y(); y < yEnd; y += step) {
+        for (int x = region.x(); x < xEnd; x += step) {
+            if (askedToStop()) {
+                return false;
+            }
+            Rect tileRect(Point(x, y), Size(std::min(step, xEnd - x), std::min(step, yEnd - y)));
+            if (skipTile && skipTile(tileRect)) {
+                continue;
+            }
+            //Requesting the tile at its own size reads the full-resolution level
+            Size outputSize((tileRect.width() + downsample - 1) / downsample,
+                (tileRect.height() + downsample - 1) / downsample);
+            RawImage tile = compositor->getImage(tileRect, outputSize);
+            visitor(tileRect, tile);
+        }
+    }
+    return true;
+}//end forEachSourceTile
+
+bool OpticalDensityThreshold::buildResponseHistogram() {
+    if (false == static_cast<bool>(m_reportResponse)) {
+        m_responseHistogram.reset();
+        return false;
+    }
+    //The histogram does not depend on the threshold value or behavior
+    bool region_changed = m_regionToProcess.isChanged() 
+        || (!m_regionToProcess.isUserDefined() && m_displayArea.isChanged());
+    if ((nullptr != m_responseHistogram)
+        && !region_changed
+        && !weightsChanged()) {
+        return false;
+    }
+    m_responseHistogram.reset();
+
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    auto histogram = std::make_shared<ODHistogram>(m_thresholdMaxVal, m_responseHistogramBins);
+    bool completed = forEachSourceTile(getReportRegion(),
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            histogram->Add(parameters->weightedOD(pixels.GetRGB(px)));
+        }
+    });
+    if (false == completed) {
+        return false;
+    }
+    m_responseHistogram = histogram;
+    return true;
+}//end buildResponseHistogram
+
+std::string OpticalDensityThreshold::generateResponseReport() const {
+    std::ostringstream ss;
+    if (nullptr == m_responseHistogram) {
+        return ss.str();
+    }
+    std::int64_t totalCount = m_responseHistogram->GetTotalCount();
+    bool retainHigher = (image::tile::ODThresholdKernel::Behavior::RETAIN_HIGHER_OD == static_cast<int>(m_retainment));
+    ss << "Threshold response (" << (retainHigher ? "higher" : "lower") << " OD retained, "
+        << totalCount << " pixels)" << std::endl;
+    ss << "threshold,retained_pixels,retained_percent,integrated_od" << std::endl;
+    int numSteps = static_cast<int>(std::round(m_thresholdMaxVal / m_thresholdStepSizeVal));
+    for (int step = 0; step <= numSteps; step++) {
+        double threshold = step * m_thresholdStepSizeVal;
+        std::int64_t count = 0;
+        double ODSum = 0.0;
+        m_responseHistogram->GetRetained(threshold, retainHigher, count, ODSum);
+        double percent = (totalCount > 0) ? 100.0 * static_cast<double>(count) / totalCount : 0.0;
+        ss << std::fixed << std::setprecision(2) << threshold << ","
+            << count << ","
+            << std::setprecision(3) << percent << ","
+            << std::setprecision(1) << ODSum << std::endl;
+    }
+    return ss.str();
+}//end generateResponseReport
+
+std::vector<double> OpticalDensityThreshold::getBandThresholds() {
+    return { m_weakThreshold, m_moderateThreshold, m_strongThreshold };
+}//end getBandThresholds
+
+bool OpticalDensityThreshold::buildBandCounts() {
+    if ((1 != static_cast<int>(m_outputType)) && (false == static_cast<bool>(m_reportHScore))) {
+        m_bandCounts.clear();
+        return false;
+    }
+    //The counts do not depend on the threshold value or behavior
+    bool region_changed = m_regionToProcess.isChanged() 
+        || (!m_regionToProcess.isUserDefined() && m_displayArea.isChanged());
+    if (!m_bandCounts.empty()
+        && !region_changed
+        && !weightsChanged()
+        && !m_weakThreshold.isChanged()
+        && !m_moderateThreshold.isChanged()
+        && !m_strongThreshold.isChanged()) {
+        return false;
+    }
+    m_bandCounts.clear();
+
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    //Label every pixel and count the labels in the same pass
+    std::vector<std::int64_t> counts(getBandThresholds().size() + 1, 0);
+    bool completed = forEachSourceTile(getReportRegion(),
+        [&](const Rect &tileRect, const RawImage &tile) {
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            counts[parameters->bandLabel(parameters->weightedOD(pixels.GetRGB(px)))]++;
+        }
+    });
+    if (false == completed) {
+        return false;
+    }
+    m_bandCounts = counts;
+    return true;
+}//end buildBandCounts
+
+std::string OpticalDensityThreshold::generateBandReport() const {
+    std::ostringstream ss;
+    if (m_bandCounts.empty()) {
+        return ss.str();
+    }
+    std::int64_t totalCount = 0;
+    for (auto c : m_bandCounts) { totalCount += c; }
+    ss << "Intensity bands (" << totalCount << " pixels)" << std::endl;
+    for (std::size_t label = 0; label < m_bandCounts.size(); label++) {
+        double percent = (totalCount > 0) ? 100.0 * static_cast<double>(m_bandCounts[label]) / totalCount : 0.0;
+        std::string name = (label < m_bandNames.size()) ? m_bandNames[label] : std::to_string(label);
+        ss << name << ": " << m_bandCounts[label] << " pixels (" 
+            << std::fixed << std::setprecision(2) << percent << "%)" << std::endl;
+    }
+    return ss.str();
+}//end generateBandReport
+
+std::string OpticalDensityThreshold::generateHScoreReport() const {
+    std::ostringstream ss;
+    if ((false == static_cast<bool>(m_reportHScore)) || m_bandCounts.empty()) {
+        return ss.str();
+    }
+    std::int64_t totalCount = 0;
+    for (auto c : m_bandCounts) { totalCount += c; }
+    //Every band above the lowest is positive, scored by its position (weak 1, moderate 2, strong 3)
+    std::int64_t positiveCount = 0;
+    double hScore = 0.0;
+    for (std::size_t label = 1; label < m_bandCounts.size(); label++) {
+        double percent = (totalCount > 0) ? 100.0 * static_cast<double>(m_bandCounts[label]) / totalCount : 0.0;
+        positiveCount += m_bandCounts[label];
+        hScore += static_cast<double>(label) * percent;
+    }
+    double positivePercent = (totalCount > 0) ? 100.0 * static_cast<double>(positiveCount) / totalCount : 0.0;
+    ss << "Positive: " << positiveCount << " pixels ("
+        << std::fixed << std::setprecision(2) << positivePercent << "%)" << std::endl;
+    ss << "H-score: " << std::fixed << std::setprecision(1) << hScore << std::endl;
+    return ss.str();
+}//end generateHScoreReport
+
+bool OpticalDensityThreshold::buildObjectReport() {
+    if (false == static_cast<bool>(m_reportObjects)) {
+        m_objectReport = "";
+        return false;
+    }
+    //The objects depend on every parameter that changes the mask
+    if (!m_objectReport.empty()
+        && !m_reportObjects.isChanged()
+        && !m_objectMinArea.isChanged()
+        && !m_smoothingSigma.isChanged()
+        && !m_adaptiveMethod.isChanged()
+        && !m_adaptiveRadius.isChanged()
+        && !m_adaptiveK.isChanged()
+        && !m_morphology.isChanged()
+        && !m_morphologyRadius.isChanged()
+        && !m_regionToProcess.isChanged()
+        && !m_threshold.isChanged()
+        && !m_autoThreshold.isChanged()
+        && !m_autoPercentile.isChanged()
+        && !m_retainment.isChanged()
+        && !weightsChanged()
+        && !m_RThreshold.isChanged()
+        && !m_GThreshold.isChanged()
+        && !m_BThreshold.isChanged()) {
+        return false;
+    }
+    m_objectReport = "";
+
+    //Objects are listed as they are completed, so only the seams between tiles are kept in memory
+    Rect region = getProcessingRegion();
+    std::int64_t minArea = static_cast<int>(m_objectMinArea);
+    std::int64_t numObjects = 0;
+    std::int64_t totalArea = 0;
+    std::ostringstream rows;
+    ComponentLabeler labeler(region.width(), [&](const ComponentLabeler::Component &c) {
+        if (c.area < minArea) {
+            return;
+        }
+        numObjects++;
+        totalArea += c.area;
+        if (numObjects <= m_objectReportMaxRows) {
+            rows << numObjects << ","
+                << c.area << ","
+                << std::fixed << std::setprecision(1)
+                << region.x() + c.GetCentroidX() << ","
+                << region.y() + c.GetCentroidY() << ","
+                << region.x() + c.minX << ","
+                << region.y() + c.minY << ","
+                << c.maxX - c.minX + 1 << ","
+                << c.maxY - c.minY + 1 << ","
+                << c.perimeter << std::endl;
+        }
+    });
+    bool completed = forEachMaskTile(region,
+        [&](const Rect &tileRect, const std::vector<std::uint8_t> &mask) {
+        labeler.AddTile(tileRect.x() - region.x(), tileRect.y() - region.y(),
+            tileRect.width(), tileRect.height(), mask);
+    });
+    if (false == completed) {
+        return false;
+    }
+    labeler.Finish();
+
+    std::ostringstream ss;
+    double meanArea = (numObjects > 0) ? static_cast<double>(totalArea) / numObjects : 0.0;
+    ss << "Objects: " << numObjects << " (at least " << minArea << " pixels), mean area "
+        << std::fixed << std::setprecision(1) << meanArea << " pixels" << std::endl;
+    ss << "object,area,centroid_x,centroid_y,x,y,width,height,perimeter" << std::endl;
+    ss << rows.str();
+    if (numObjects > m_objectReportMaxRows) {
+        ss << "(" << numObjects - m_objectReportMaxRows << " more objects not listed)" << std::endl;
+    }
+    m_objectReport = ss.str();
+    return true;
+}//end buildObjectReport
+
+void OpticalDensityThreshold::updateReport() {
+    buildResponseHistogram();
+    buildBandCounts();
+    buildObjectReport();
+
+    m_report = "";
+    m_report += generateStainEstimateReport();
+    m_report += generateAutoThresholdReport();
+    m_report += generateBandReport();
+    m_report += generateHScoreReport();
+    m_report += generateIndexedReport();
+    m_report += m_objectReport;
+    m_report += generateResponseReport();
+    m_report += generateBufferPoolReport();
+    m_outputText.sendText(m_report);
+}//end updateReport
+
+std::string OpticalDensityThreshold::generateBufferPoolReport() {
+    BufferPool::Stats stats = m_bufferPool->GetStats();
+    std::size_t leases = stats.hits + stats.misses;
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "Tile buffer pool: " << stats.freeBuffers << " free (" 
+        << stats.freeBytes / (1024.0 * 1024.0) << " MB), " << stats.leasedBuffers << " in use";
+    if (leases > 0) {
+        ss << ", " << 100.0 * stats.hits / leases << "% of " << leases << " leases reused";
+    }
+    ss << std::endl;
+    return ss.str();
+}//end generateBufferPoolReport
+
+Rect OpticalDensityThreshold::getReportRegion() {
+    std::shared_ptr<GraphicItemBase> roi = m_regionToProcess;
+    if (nullptr != roi) {
+        return containingRect(roi->graphic());
+    }
+    DisplayRegion region = m_displayArea;
+    return region.source_region;
+}//end getReportRegion
+
+Rect OpticalDensityThreshold::getProcessingRegion() {
+    std::shared_ptr<GraphicItemBase> roi = m_regionToProcess;
+    if (nullptr != roi) {
+        return containingRect(roi->graphic());
+    }
+    return Rect(Point(0, 0), image::getDimensions(image(), 0));
+}//end getProcessingRegion
+
+std::shared_ptr<IntegralHistogram> OpticalDensityThreshold::getIntegralHistogram(int level) {
+    //The index does not depend on the threshold value, behavior or ROI
+    auto found = m_integralHistograms.find(level);
+    if (found != m_integralHistograms.end()) {
+        return found->second;
+    }
+
+    //Cells of the index are the tiles streamed at the level's resolution
+    int downsample = 1 << level;
+    Rect slide(Point(0, 0), image::getDimensions(image(), 0));
+    int cellSpan = m_streamTileSize * downsample;
+    auto index = std::make_shared<IntegralHistogram>(
+        (slide.width() + cellSpan - 1) / cellSpan, (slide.height() + cellSpan - 1) / cellSpan,
+        m_thresholdMaxVal, m_integralHistogramBins);
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    ODHistogram cellHistogram(m_thresholdMaxVal, m_integralHistogramBins);
+    bool completed = forEachSourceTile(slide,
+        [&](const Rect &tileRect, const RawImage &tile) {
+        cellHistogram = ODHistogram(m_thresholdMaxVal, m_integralHistogramBins);
+        image::PixelAccessor pixels(tile);
+        int numPixels = pixels.GetNumPixels();
+        for (int px = 0; px < numPixels; px++) {
+            cellHistogram.Add(parameters->weightedOD(pixels.GetRGB(px)));
+        }
+        index->SetCell(tileRect.x() / cellSpan, tileRect.y() / cellSpan, cellHistogram);
+    }, nullptr, downsample);
+    if (false == completed) {
+        return nullptr;
+    }
+    index->Build();
+    m_integralHistograms[level] = index;
+    return index;
+}//end getIntegralHistogram
+
+bool OpticalDensityThreshold::countRetainedDirect(const Rect &levelRect, int downsample,
+    const IntegralHistogram &index, int edgeBin, std::int64_t &retained, std::int64_t &total) {
+    if ((levelRect.width() <= 0) || (levelRect.height() <= 0)) {
+        return true;
+    }
+    if (askedToStop()) {
+        return false;
+    }
+    auto compositor = std::make_unique<image::tile::Compositor>(image()->getFactory());
+    Rect sourceRect(Point(levelRect.x() * downsample, levelRect.y() * downsample),
+        Size(levelRect.width() * downsample, levelRect.height() * downsample));
+    RawImage strip = compositor->getImage(sourceRect, levelRect.size());
+    image::PixelAccessor pixels(strip);
+    int numPixels = pixels.GetNumPixels();
+    auto parameters = m_ODThreshold_kernel->getParameters();
+    bool retainHigher = (image::tile::ODThresholdKernel::Behavior::RETAIN_HIGHER_OD == parameters->m_behavior);
+    bool retainLower = (image::tile::ODThresholdKernel::Behavior::RETAIN_LOWER_OD == parameters->m_behavior);
+    for (int px = 0; px < numPixels; px++) {
+        //The same bin rule as the index, so the strips and the cells agree
+        bool atOrAbove = (index.GetBinIndex(parameters->weightedOD(pixels.GetRGB(px))) >= edgeBin);
+        if ((retainHigher && atOrAbove) || (retainLower && !atOrAbove)) {
+            retained++;
+        }
+    }
+    total += numPixels;
+    return true;
+}//end countRetainedDirect
+
+std::string OpticalDensityThreshold::generateIndexedReport() {
+    std::ostringstream ss;
+    if (false == static_cast<bool>(m_reportIndexed)) {
+        return ss.str();
+    }
+    //The index holds weighted OD only
+    if (image::tile::ODThresholdKernel::WEIGHTED_OD != getThresholdType()) {
+        ss << "Retained area from index: only available for the average and weighted OD threshold types" << std::endl;
+        return ss.str();
+    }
+    int level = m_indexLevel;
+    auto index = getIntegralHistogram(level);
+    if (nullptr == index) {
+        return ss.str();
+    }
+
+    //Region in the coordinates of the index level
+    int downsample = 1 << level;
+    Rect region = getReportRegion();
+    int lx0 = region.x() / downsample;
+    int ly0 = region.y() / downsample;
+    int lx1 = (region.x() + region.width()) / downsample;
+    int ly1 = (region.y() + region.height()) / downsample;
+
+    //Whole cells inside the region come from the index, the partial cells around them are read
+    int cellSize = m_streamTileSize;
+    int c0 = std::min((lx0 + cellSize - 1) / cellSize, index->GetCellsAcross());
+    int r0 = std::min((ly0 + cellSize - 1) / cellSize, index->GetCellsDown());
+    int c1 = std::max(c0, std::min(lx1 / cellSize, index->GetCellsAcross()));
+    int r1 = std::max(r0, std::min(ly1 / cellSize, index->GetCellsDown()));
+
+    //The threshold is snapped to the nearest bin edge, so every whole cell is a few table lookups
+    double binWidth = m_thresholdMaxVal / m_integralHistogramBins;
+    int edgeBin = std::min(std::max(static_cast<int>(std::lround(getThresholdValue() / binWidth)), 0), 
+        index->GetNumBins());
+    int retainment = m_retainment;
+
+    std::int64_t retained = 0, total = 0;
+    if ((c1 > c0) && (r1 > r0)) {
+        std::int64_t atOrAbove = index->GetCountAtOrAbove(c0, r0, c1, r1, edgeBin);
+        std::int64_t cellTotal = index->GetCount(c0, r0, c1, r1);
+        if (image::tile::ODThresholdKernel::Behavior::RETAIN_HIGHER_OD == retainment) {
+            retained += atOrAbove;
+        }
+        else if (image::tile::ODThresholdKernel::Behavior::RETAIN_LOWER_OD == retainment) {
+            retained += cellTotal - atOrAbove;
+        }
+        total += cellTotal;
+    }
+    //Without whole cells, the bottom strip covers the whole region
+    int ix0 = std::max(lx0, c0 * cellSize), ix1 = std::min(lx1, c1 * cellSize);
+    int iy0 = std::max(ly0, r0 * cellSize), iy1 = std::min(ly1, r1 * cellSize);
+    if (ix1 <= ix0 || iy1 <= iy0) {
+        ix0 = ix1 = lx0;
+        iy0 = iy1 = ly0;
+    }
+    const IntegralHistogram &bins = *index;
+    bool completed = 
+        //Top and bottom strips, full width
+        countRetainedDirect(Rect(Point(lx0, ly0), Size(lx1 - lx0, iy0 - ly0)), downsample, bins, edgeBin, retained, total)
+        && countRetainedDirect(Rect(Point(lx0, iy1), Size(lx1 - lx0, ly1 - iy1)), downsample, bins, edgeBin, retained, total)
+        //Left and right strips, between the top and bottom strips
+        && countRetainedDirect(Rect(Point(lx0, iy0), Size(ix0 - lx0, iy1 - iy0)), downsample, bins, edgeBin, retained, total)
+        && countRetainedDirect(Rect(Point(ix1, iy0), Size(lx1 - ix1, iy1 - iy0)), downsample, bins, edgeBin, retained, total);
+    if (false == completed) {
+        return "";
+    }
+
+    double percent = (total > 0) ? 100.0 * static_cast<double>(retained) / total : 0.0;
+    ss << "Retained area (index level " << level << ", threshold " << std::fixed << std::setprecision(2) 
+        << edgeBin * binWidth << "): " << retained << " of " << total 
+        << " pixels (" << percent << "%)" << std::endl;
+    if (downsample > 1) {
+        ss << "Estimated full-resolution retained area: " 
+            << retained * downsample * downsample << " pixels" << std::endl;
+    }
+    return ss.str();
+}//end generateIndexedReport
+
 } // namespace algorithm
 } // namespace sedeen
@@ -31,6 +31,26 @@
 #include "algorithm/Results.h"
 
 #include "ODThresholdKernel.h"
+#include "MaskPyramid.h"
+#include "ODPyramid.h"
+#include "TileODSummary.h"
+#include "ODHistogram.h"
+#include "IntegralHistogram.h"
+#include "IncrementalMask.h"
+#include "StainMatrix.h"
+#include "StainEstimator.h"
+#include "WhitePointEstimator.h"
+#include "ColorLUT.h"
+#include "BufferPool.h"
+#include "CancellationToken.h"
+#include "ComponentLabeler.h"
+#include "MaskMorphology.h"
+#include "HaloTileStream.h"
+#include "GaussianSmoothing.h"
+#include "LocalThreshold.h"
+
+#include <functional>
+#include <map>
 
 namespace sedeen {
 namespace tile {
@@ -60,13 +80,251 @@ private:
     /// otherwise
     bool buildPipeline();
 
+    /// Creates the mask pyramid from the full-resolution threshold result, if that display option is chosen
+    //
+    /// \return 
+    /// TRUE if the mask pyramid was built or removed, FALSE otherwise
+    bool buildMaskPyramid();
+
+    /// Gets the kernel threshold type of the chosen m_thresholdType option
+    image::tile::ODThresholdKernel::ThresholdType getThresholdType();
+
+    /// Gets the kernel output type of the chosen m_outputType option
+    image::tile::ODThresholdKernel::OutputType getOutputType();
+
+    /// Checks whether the output is a binary mask (retained pixels or alpha mask), which the
+    /// zoomed-out and filtered displays can draw
+    bool isMaskOutput();
+
+    /// Writes one pixel of a mask display: the source color shaded by the coverage (0 to 1),
+    /// or for the alpha mask the source color with the coverage as alpha
+    static void setMaskPixel(RawImage &output, int px, const std::array<int, 3> &rgb,
+        double coverage, bool alphaMask);
+
+    /// Builds the colormap of the heatmap output
+    static std::vector<std::array<int, 3>> getHeatmapColors();
+
+    /// Gets the estimated stain vectors if there are any, otherwise those of the chosen m_stainMatrix option
+    StainMatrix getStainMatrix();
+
+    /// Checks whether any parameter that changes the kernel's weighted OD or color rule has changed
+    bool weightsChanged();
+
+    /// Builds the color table of the color classification threshold type from the kernel's
+    /// weighted OD decision and the hue range, or removes it for the other types
+    //
+    /// If both sample regions are chosen, the table is instead trained from the colors of their
+    /// bounding rectangles. The table is only rebuilt when the inputs it was built from change.
+    std::shared_ptr<ColorLUT> buildColorLUT();
+
+    /// Reads the colors of a region at the lowest resolution that still has m_stainEstimateMaxPixels pixels
+    //
+    /// \return 
+    /// TRUE if the whole region was read, FALSE if processing was stopped
+    bool sampleColors(const Rect &region, std::vector<std::array<int, 3>> &colors);
+
+    /// Hue of an RGB color in degrees (0 to 360)
+    static double getHue(int r, int g, int b);
+
+    /// Estimates the white point of each channel from a low resolution level of the slide, if that option is chosen
+    //
+    /// \return 
+    /// TRUE if m_whitePoint was changed, FALSE otherwise
+    bool buildWhitePoint();
+
+    /// Rebuilds m_converter from the white point and the linearization curve
+    //
+    /// \return 
+    /// TRUE if m_converter was rebuilt, FALSE otherwise
+    bool buildConverter();
+
+    /// Estimates the stain vectors from a low resolution level of the processing region, if that option is chosen
+    //
+    /// \return 
+    /// TRUE if the estimate was recalculated, FALSE otherwise
+    bool buildStainEstimate();
+
+    /// Gets the weights of the Weighted Average OD type from the estimated vector of the chosen stain
+    std::array<double, 3> getEstimatedWeights();
+
+    /// Reports the estimated white point, stain vectors and weights
+    std::string generateStainEstimateReport();
+
+    /// Creates the weighted OD histogram of a low resolution level of the processing region, if an automatic threshold is chosen
+    //
+    /// \return 
+    /// TRUE if the histogram was recalculated, FALSE otherwise
+    bool buildAutoHistogram();
+
+    /// Gets the threshold value: from the automatic threshold method if one is chosen, otherwise m_threshold
+    double getThresholdValue();
+
+    /// Reports the value chosen by the automatic threshold
+    std::string generateAutoThresholdReport();
+
+    /// Gets the range of quantized weighted OD retained by the threshold value and behavior
+    IncrementalMask::KeyRange getRetainedKeyRange();
+
+    /// Creates the mean OD pyramid of the ROI, if that display option is chosen
+    //
+    /// \return 
+    /// TRUE if the mean OD pyramid was built or removed, FALSE otherwise
+    bool buildODPyramid();
+
+    /// Draws the display area from a pyramid when it is zoomed out far enough
+    //
+    /// \return 
+    /// TRUE if the result was updated, FALSE if the pipeline should be used instead
+    bool updateZoomedOutDisplay();
+
+    /// Draws the smoothed and cleaned mask of the display area, when either is chosen and visible at the display resolution
+    //
+    /// \return 
+    /// TRUE if the result was updated, FALSE if the pipeline should be used instead
+    bool updateFilteredDisplay();
+
+    /// Computes the pipeline's tiles of the display area on a worker thread, so they are cached for m_result
+    //
+    /// The plugin thread checks for a stop request every m_stopPollInterval ms meanwhile, and cancels
+    /// the tiles in progress if there is one. The Cache then holds cancelled tiles and must be dropped.
+    //
+    /// \return 
+    /// TRUE if all tiles were computed, FALSE if processing was stopped
+    bool prefetchDisplay();
+
+    /// Gets the mask cleanup of the chosen m_morphology option and radius
+    MaskMorphology getMorphology();
+
+    /// Gets the OD smoothing of the chosen m_smoothingSigma
+    GaussianSmoothing getSmoothing();
+
+    /// Gets the adaptive threshold of the chosen m_adaptiveMethod option, or none if it does not apply to the threshold type
+    LocalThreshold getLocalThreshold();
+
+    /// Fills \p mask with 1 for retained pixels and 0 otherwise, from the channel ODs of a row-major image
+    void thresholdOD(const std::vector<GaussianSmoothing::ODPixel> &od, int width, int height,
+        const LocalThreshold &local, std::vector<std::uint8_t> &mask);
+
+    /// Converts the R, G and B values of a pixel to channel optical densities
+    static GaussianSmoothing::ODPixel toODPixel(const ODConversion &converter, const std::array<int, 3> &rgb);
+
+    /// Draws the cells of a pyramid level that intersect the display area, shading the source by each cell value
+    //
+    /// \return 
+    /// TRUE if the result was updated, FALSE if no cells intersect the display area
+    bool updateFromPyramidCells(const Rect &pyramidRegion, int factor, int levelWidth, int levelHeight,
+        const std::function<double(int, int)> &cellValue);
+
+    /// Visits a region of the source image at full resolution, one tile at a time
+    //
+    /// \param skipTile
+    /// Optional test run before reading each tile; tiles for which it returns TRUE are not read
+    //
+    /// \param downsample
+    /// Read the tiles at this fraction of full resolution
+    //
+    /// \return 
+    /// TRUE if the whole region was visited, FALSE if processing was stopped
+    bool forEachSourceTile(const Rect &region,
+        const std::function<void(const Rect&, const RawImage&)> &visitor,
+        const std::function<bool(const Rect&)> &skipTile = nullptr,
+        int downsample = 1);
+
+    /// Visits the threshold mask of a region at full resolution, one tile at a time, after the OD smoothing and mask cleanup
+    //
+    /// Each tile is smoothed and cleaned with a halo of neighboring pixels, so the result does not depend on the tiling.
+    /// Halo pixels shared with neighboring tiles are read only once. Tiles are m_streamTileSize
+    /// pixels across, or twice the halo if that is larger.
+    //
+    /// \return 
+    /// TRUE if the whole region was visited, FALSE if processing was stopped
+    bool forEachMaskTile(const Rect &region,
+        const std::function<void(const Rect&, const std::vector<std::uint8_t>&)> &visitor);
+
+    /// Gets the bounding rectangle of the ROI, or the whole slide if no ROI is chosen
+    Rect getProcessingRegion();
+
+    /// Gets the bounding rectangle of the ROI, or the display area if no ROI is chosen
+    Rect getReportRegion();
+
+    /// Creates the weighted OD histogram of the report region, if the threshold response is requested
+    //
+    /// \return 
+    /// TRUE if the histogram was rebuilt, FALSE otherwise
+    bool buildResponseHistogram();
+
+    /// Lists the retained area and integrated OD at each threshold step, as CSV text
+    std::string generateResponseReport() const;
+
+    /// Reports the occupancy and reuse of the kernel's tile buffer pool
+    std::string generateBufferPoolReport();
+
+    /// Gets the whole-slide weighted OD index of a resolution level, building it if needed
+    //
+    /// \return 
+    /// The index, or nullptr if processing was stopped
+    std::shared_ptr<IntegralHistogram> getIntegralHistogram(int level);
+
+    /// Counts the pixels of a rectangle (in the coordinates of a downsampled level) that are
+    /// retained by a threshold at the lower edge of a bin of the index
+    //
+    /// \return 
+    /// FALSE if processing was stopped, TRUE otherwise
+    bool countRetainedDirect(const Rect &levelRect, int downsample,
+        const IntegralHistogram &index, int edgeBin, std::int64_t &retained, std::int64_t &total);
+
+    /// Reports the retained area of the report region using the whole-slide index
+    std::string generateIndexedReport();
+
+    /// Gets the weighted OD thresholds of the weak, moderate and strong intensity bands
+    std::vector<double> getBandThresholds();
+
+    /// Counts the pixels of each intensity band in the report region, if the label map output or H-score report is chosen
+    //
+    /// \return 
+    /// TRUE if the counts were recalculated, FALSE otherwise
+    bool buildBandCounts();
+
+    /// Lists the pixel count and percentage of each intensity band
+    std::string generateBandReport() const;
+
+    /// Lists the positive pixel percentage and H-score (0 to 300) of the intensity band counts
+    std::string generateHScoreReport() const;
+
+    /// Labels the connected objects of the threshold mask of the processing region, if the object report is chosen
+    //
+    /// \return 
+    /// TRUE if m_objectReport was recalculated, FALSE otherwise
+    bool buildObjectReport();
+
+    /// Updates m_report and sends it to the text result
+    void updateReport();
+
 private:
+    /// Options of m_zoomedOutDisplay
+    enum ZoomedOutDisplay {
+        THRESHOLD_DOWNSAMPLED,
+        MASK_COVERAGE,
+        MASK_MAJORITY,
+        MEAN_OD_PYRAMID
+    };
+
+    /// Options of m_linearization
+    enum Linearization {
+        NO_CURVE,
+        SRGB_CURVE,
+        GAMMA_CURVE
+    };
+
     DisplayAreaParameter m_displayArea;
 
     GraphicItemParameter m_regionToProcess; //single output region
 
     /// User defined Threshold value.
     algorithm::DoubleParameter m_threshold;
+    /// Choose the threshold value automatically, and the percentile used by the Percentile method
+    algorithm::OptionParameter m_autoThreshold;
+    algorithm::DoubleParameter m_autoPercentile;
     ///Option to specify if higher or lower OD values should be retained
     algorithm::OptionParameter m_retainment;
     /// Specify the type of threshold. How should multiple pixel elements be treated?
@@ -77,6 +335,66 @@ private:
     algorithm::DoubleParameter m_GWeight;
     algorithm::DoubleParameter m_BWeight;
 
+    /// Stain vectors and chosen stain of the color deconvolution threshold type
+    algorithm::OptionParameter m_stainMatrix;
+    algorithm::OptionParameter m_stainToThreshold;
+    /// Option to measure OD relative to the slide background instead of 255
+    algorithm::BoolParameter m_estimateWhitePoint;
+    /// Tone curve decoding RGB values to linear intensity, and the exponent of the Gamma curve
+    algorithm::OptionParameter m_linearization;
+    algorithm::DoubleParameter m_gamma;
+    /// Option to estimate the stain vectors from the slide
+    algorithm::BoolParameter m_estimateStains;
+    /// Hue range retained by the color classification threshold type
+    algorithm::DoubleParameter m_hueMin;
+    algorithm::DoubleParameter m_hueMax;
+    /// Sample regions of retained and rejected colors that train the color classification table
+    GraphicItemParameter m_retainedSamples;
+    GraphicItemParameter m_rejectedSamples;
+
+    /// Choose between the retained pixels and the intensity band label map
+    algorithm::OptionParameter m_outputType;
+
+    /// Standard deviation of the Gaussian smoothing of the channel ODs before the threshold
+    algorithm::DoubleParameter m_smoothingSigma;
+
+    /// Adaptive threshold method, window radius and weight of the local standard deviation
+    algorithm::OptionParameter m_adaptiveMethod;
+    algorithm::IntegerParameter m_adaptiveRadius;
+    algorithm::DoubleParameter m_adaptiveK;
+
+    /// Morphological cleanup of the mask, and the radius of its structuring element
+    algorithm::OptionParameter m_morphology;
+    algorithm::IntegerParameter m_morphologyRadius;
+
+    ///Lowest weighted OD of the weak, moderate and strong intensity bands
+    algorithm::DoubleParameter m_weakThreshold;
+    algorithm::DoubleParameter m_moderateThreshold;
+    algorithm::DoubleParameter m_strongThreshold;
+
+    ///Weighted OD distance from the threshold spanned by the heatmap colors
+    algorithm::DoubleParameter m_heatmapRange;
+
+    ///Three per-channel threshold values
+    algorithm::DoubleParameter m_RThreshold;
+    algorithm::DoubleParameter m_GThreshold;
+    algorithm::DoubleParameter m_BThreshold;
+
+    /// How to create the output when the display is zoomed out
+    algorithm::OptionParameter m_zoomedOutDisplay;
+
+    /// Option to report the threshold response curve of the ROI
+    algorithm::BoolParameter m_reportResponse;
+    /// Option to report the retained area of the ROI from the whole-slide index
+    algorithm::BoolParameter m_reportIndexed;
+    /// Resolution level of the whole-slide index
+    algorithm::IntegerParameter m_indexLevel;
+    /// Option to report the H-score of the ROI from its intensity band counts
+    algorithm::BoolParameter m_reportHScore;
+    /// Option to report the connected objects of the mask, and the smallest object area to report
+    algorithm::BoolParameter m_reportObjects;
+    algorithm::IntegerParameter m_objectMinArea;
+
     /// The output result
     ImageResult m_result;
     TextResult m_outputText;
@@ -84,14 +402,99 @@ private:
 
     /// The intermediate image factory after thresholding
     std::shared_ptr<image::tile::Factory> m_ODThreshold_factory;
+    /// The cached kernel output before the ROI is applied, rebuilt only when the kernel's parameters change
+    std::shared_ptr<image::tile::Factory> m_kernelFactory;
+    /// Version of the kernel's parameter snapshot that m_kernelFactory was built with
+    std::uint64_t m_kernelVersion;
+    /// Milliseconds between checks for a stop request while the display tiles are computed
+    const int m_stopPollInterval;
+    /// The kernel applied by the pipeline, also used for full-resolution passes
+    std::shared_ptr<image::tile::ODThresholdKernel> m_ODThreshold_kernel;
+
+    /// Lower resolution levels reduced from the full-resolution mask
+    std::shared_ptr<MaskPyramid> m_maskPyramid;
+    /// The region of the slide covered by m_maskPyramid
+    Rect m_maskPyramidRegion;
+    /// Per-tile RGB ranges of the processing region, kept until the ROI changes.
+    /// Used by mask pyramid rebuilds without m_incrementalMask; the display does not use it.
+    std::shared_ptr<TileODSummary> m_tileSummary;
+    /// Pixels of the processing region sorted by weighted OD, kept until the ROI or weights change
+    std::shared_ptr<IncrementalMask> m_incrementalMask;
+    /// The retained key range that m_maskPyramid currently reflects
+    IncrementalMask::KeyRange m_incrementalMaskRange;
+    /// Mean per-channel OD of the full-resolution pixels, kept until the ROI changes
+    std::shared_ptr<ODPyramid> m_ODPyramid;
+    /// The region of the slide covered by m_ODPyramid
+    Rect m_ODPyramidRegion;
+    /// Weighted OD histogram of the report region, kept until the ROI or weights change
+    std::shared_ptr<ODHistogram> m_responseHistogram;
+    /// Pixel count of each intensity band in the report region
+    std::vector<std::int64_t> m_bandCounts;
+    /// Whole-slide weighted OD indexes by resolution level, kept until the weights or OD conversion change
+    std::map<int, std::shared_ptr<IntegralHistogram>> m_integralHistograms;
 
 private:
     //Member variables
     std::vector<std::string> m_retainmentOptions;
+    std::vector<std::string> m_autoThresholdOptions;
     std::vector<std::string> m_thresholdTypeOptions;
+    std::vector<std::string> m_stainMatrixOptions;
+    std::vector<std::string> m_stainToThresholdOptions;
+    std::vector<std::string> m_zoomedOutDisplayOptions;
+    std::vector<std::string> m_outputTypeOptions;
+    std::vector<std::string> m_adaptiveMethodOptions;
+    std::vector<std::string> m_morphologyOptions;
+    std::vector<std::string> m_linearizationOptions;
+    /// Names and label map colors of the intensity bands, from lowest to highest OD
+    std::vector<std::string> m_bandNames;
+    std::vector<std::array<int, 3>> m_bandColors;
+    /// Colormap of the heatmap output, from nearest to farthest from the threshold
+    std::vector<std::array<int, 3>> m_heatmapColors;
     const double m_thresholdDefaultVal;
     const double m_thresholdMaxVal;
     const double m_thresholdStepSizeVal;
+    /// Width and height of the tiles read in full-resolution passes
+    const int m_streamTileSize;
+    /// Maximum number of cells in the finest level of m_maskPyramid and m_ODPyramid
+    const int m_maskPyramidMaxCells;
+    /// Largest processing region (in pixels) for which m_incrementalMask is kept
+    const long long m_incrementalMaskMaxPixels;
+    /// Number of bins of m_responseHistogram between 0 and m_thresholdMaxVal
+    const int m_responseHistogramBins;
+    /// Number of bins of each cell of m_integralHistograms between 0 and m_thresholdMaxVal
+    const int m_integralHistogramBins;
+    /// Object count and measurements of the processing region, kept until the mask changes
+    std::string m_objectReport;
+    /// Largest number of objects listed individually in m_objectReport
+    const std::int64_t m_objectReportMaxRows;
+    /// Dynamic range R of the standard deviation of weighted OD, used by the Sauvola adaptive threshold
+    const double m_sauvolaRange;
+    /// Weighted OD histogram of a low resolution level of the processing region, kept until the ROI or weights change
+    std::shared_ptr<ODHistogram> m_autoHistogram;
+    /// The last threshold value chosen from m_autoHistogram
+    double m_autoThresholdValue;
+    /// Largest number of pixels read for m_autoHistogram
+    const double m_autoHistogramMaxPixels;
+    /// Stain vectors estimated from the processing region, kept until the ROI changes
+    std::shared_ptr<StainMatrix> m_stainEstimate;
+    /// Largest number of pixels read for m_stainEstimate and the white point
+    const double m_stainEstimateMaxPixels;
+    /// OD conversion tables of each channel, linearized and relative to the white point, shared with the kernel
+    ODConversion m_converter;
+    /// White point (I0) of each channel, estimated from the slide or the default
+    std::array<double, 3> m_whitePoint;
+    /// Whether m_whitePoint was estimated from the slide
+    bool m_whitePointSampled;
+    /// Whether m_converter was rebuilt in this run
+    bool m_converterChanged;
+    /// Decision of every RGB triple for the color classification threshold type
+    std::shared_ptr<ColorLUT> m_colorLUT;
+    /// Threshold, behavior, projection and hue range that m_colorLUT was built from, or the sample rectangles it was trained on
+    std::vector<double> m_colorLUTKey;
+    /// Per-tile working buffers of the kernel, kept across kernel rebuilds
+    std::shared_ptr<BufferPool> m_bufferPool;
+    /// Cancelled when the pipeline is rebuilt or the algorithm is asked to stop, so tiles in progress stop
+    std::shared_ptr<CancellationToken> m_cancellation;
 };
 
 } // namespace algorithm
@@ -0,0 +1,99 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_PIXELACCESSOR_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_PIXELACCESSOR_H
+
+#include "global/ColorSpace.h"
+#include "global/RawImage.h"
+
+#include <array>
+#include <cassert>
+
+namespace sedeen {
+namespace image {
+
+///Read the RGB elements of the pixels of a RawImage, independent of its PixelOrder
+//
+///Grayscale (or single channel) images return the same value for R, G and B.
+class PixelAccessor {
+public:
+    ///Constructor: the image must outlive the accessor
+    explicit PixelAccessor(const RawImage &image) :
+        m_image(image),
+        m_pixelOrder(image.order()),
+        m_numChannels(static_cast<int>(channels(image))),
+        m_numPixels(0),
+        m_srcToOutIndex({ 0,1,2 })
+    {
+        m_numPixels = (m_numChannels > 0) ? static_cast<int>(image.count() / m_numChannels) : 0;
+        //If source is Grayscale, use source channel 0 for all.
+        if ((image.colorSpace().colorModel() == ColorModel::Grayscale) || (m_numChannels == 1)) {
+            m_srcToOutIndex = { 0,0,0 };
+        }
+    }//end constructor
+
+    ///Number of pixels in the image
+    inline int GetNumPixels() const { return m_numPixels; }
+
+    ///Get the value of the R (0), G (1) or B (2) element of a pixel
+    inline int GetElement(const int &_px, const int &_ch) const {
+        return m_image.at(GetIndex(m_pixelOrder, m_numPixels, m_numChannels, 
+            _px, m_srcToOutIndex[_ch])).as<int>();
+    }//end GetElement
+
+    ///Get the R, G and B values of a pixel
+    inline std::array<int, 3> GetRGB(const int &_px) const {
+        return { GetElement(_px, 0), GetElement(_px, 1), GetElement(_px, 2) };
+    }//end GetRGB
+
+    ///Index of a pixel element in a buffer with the given PixelOrder and number of channels
+    inline static std::size_t GetIndex(const PixelOrder &_order, const int &_numPixels, 
+        const int &_numChannels, const int &_px, const int &_ch) {
+        if (_order == PixelOrder::Interleaved) {
+            //RGB RGB RGB ... (if numChannels=3)
+            return static_cast<std::size_t>(_px) * _numChannels + _ch;
+        }
+        else if (_order == PixelOrder::Planar) {
+            //RRR... GGG... BBB...
+            return static_cast<std::size_t>(_ch) * _numPixels + _px;
+        }
+        //Invalid value of pixelOrder
+        assert(false && "Invalid PixelOrder defined");
+        return 0;
+    }//end GetIndex
+
+private:
+    const RawImage &m_image;
+    PixelOrder m_pixelOrder;
+    int m_numChannels;
+    int m_numPixels;
+    ///Source channel to read for each of R, G and B
+    std::array<int, 3> m_srcToOutIndex;
+};
+
+} // namespace image
+} // namespace sedeen
+
+#endif
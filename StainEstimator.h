@@ -0,0 +1,170 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_STAINESTIMATOR_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_STAINESTIMATOR_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "StainMatrix.h"
+
+///Estimates the OD vectors of two stains from a sample of pixel optical densities (Macenko et al.)
+//
+///Pixels with little stain are ignored. The remaining OD vectors are projected onto
+///the plane of the two largest principal directions, and the stains are taken as the
+///directions at a low and a high percentile of the angle of the projections, which is
+///robust to the few pixels that lie outside the stain cone.
+class StainEstimator {
+public:
+    ///Constructor: the lowest channel OD of a stained pixel, and the angle percentile (0 to 50)
+    StainEstimator(const double &_minOD = 0.15, const double &_percentile = 1.0) :
+        m_minOD(_minOD),
+        m_percentile(_percentile),
+        m_samples()
+    {
+    }//end constructor
+
+    virtual ~StainEstimator(void) {
+    }//end destructor
+
+    ///Add the channel ODs of a pixel, unless it is too light
+    inline void Add(const StainMatrix::Vector &_od) {
+        if ((_od[0] < m_minOD) || (_od[1] < m_minOD) || (_od[2] < m_minOD)) { return; }
+        m_samples.push_back({ static_cast<float>(_od[0]), static_cast<float>(_od[1]), static_cast<float>(_od[2]) });
+    }//end Add
+
+    inline std::size_t GetNumSamples() const { return m_samples.size(); }
+    inline static std::size_t GetMinSamples() { return 100; }
+
+    ///Estimate two normalized stain vectors, the one with the larger red OD first
+    //
+    ///\return FALSE if there are too few stained pixels
+    bool Estimate(StainMatrix::Vector &_stain1, StainMatrix::Vector &_stain2) const {
+        if (m_samples.size() < GetMinSamples()) { return false; }
+        //Covariance of the OD vectors
+        double n = static_cast<double>(m_samples.size());
+        std::array<double, 3> mean = { 0.0,0.0,0.0 };
+        for (const auto &s : m_samples) {
+            for (int i = 0; i < 3; i++) { mean[i] += s[i]; }
+        }
+        for (int i = 0; i < 3; i++) { mean[i] /= n; }
+        std::array<std::array<double, 3>, 3> cov = {};
+        for (const auto &s : m_samples) {
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) {
+                    cov[i][j] += (s[i] - mean[i]) * (s[j] - mean[j]);
+                }
+            }
+        }
+        //Principal directions, pointing toward positive OD
+        std::array<StainMatrix::Vector, 3> vectors;
+        std::array<double, 3> values;
+        Eigen(cov, values, vectors);
+        std::array<int, 3> order = { 0,1,2 };
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return values[a] > values[b]; });
+        StainMatrix::Vector e1 = vectors[order[0]], e2 = vectors[order[1]];
+        if (e1[0] + e1[1] + e1[2] < 0.0) { for (auto &v : e1) { v = -v; } }
+        if (e2[0] + e2[1] + e2[2] < 0.0) { for (auto &v : e2) { v = -v; } }
+
+        //Angles of the projections onto the plane
+        std::vector<double> angles;
+        angles.reserve(m_samples.size());
+        for (const auto &s : m_samples) {
+            double p1 = s[0] * e1[0] + s[1] * e1[1] + s[2] * e1[2];
+            double p2 = s[0] * e2[0] + s[1] * e2[1] + s[2] * e2[2];
+            angles.push_back(std::atan2(p2, p1));
+        }
+        double low = GetPercentile(angles, m_percentile);
+        double high = GetPercentile(angles, 100.0 - m_percentile);
+        StainMatrix::Vector v1, v2;
+        for (int i = 0; i < 3; i++) {
+            v1[i] = std::cos(low) * e1[i] + std::sin(low) * e2[i];
+            v2[i] = std::cos(high) * e1[i] + std::sin(high) * e2[i];
+        }
+        v1 = StainMatrix::Normalize(v1);
+        v2 = StainMatrix::Normalize(v2);
+        //Order as hematoxylin first, which absorbs more red than eosin or DAB
+        _stain1 = (v1[0] >= v2[0]) ? v1 : v2;
+        _stain2 = (v1[0] >= v2[0]) ? v2 : v1;
+        return true;
+    }//end Estimate
+
+private:
+    ///Value at a percentile (0 to 100) of a list, which is partially reordered
+    inline static double GetPercentile(std::vector<double> &_values, const double &_percent) {
+        std::size_t index = static_cast<std::size_t>(std::round(_percent / 100.0 * (_values.size() - 1)));
+        std::nth_element(_values.begin(), _values.begin() + index, _values.end());
+        return _values[index];
+    }//end GetPercentile
+
+    ///Eigenvalues and eigenvectors of a symmetric 3x3 matrix, by Jacobi rotations
+    static void Eigen(std::array<std::array<double, 3>, 3> _a, std::array<double, 3> &_values,
+        std::array<StainMatrix::Vector, 3> &_vectors) {
+        std::array<std::array<double, 3>, 3> v = { { { 1,0,0 },{ 0,1,0 },{ 0,0,1 } } };
+        for (int sweep = 0; sweep < 50; sweep++) {
+            double offDiagonal = std::abs(_a[0][1]) + std::abs(_a[0][2]) + std::abs(_a[1][2]);
+            if (offDiagonal < 1e-15) { break; }
+            for (int p = 0; p < 2; p++) {
+                for (int q = p + 1; q < 3; q++) {
+                    if (std::abs(_a[p][q]) < 1e-300) { continue; }
+                    double theta = (_a[q][q] - _a[p][p]) / (2.0 * _a[p][q]);
+                    double t = ((theta >= 0.0) ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                    double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                    //Rotate rows and columns p and q
+                    for (int k = 0; k < 3; k++) {
+                        double akp = _a[k][p], akq = _a[k][q];
+                        _a[k][p] = c * akp - s * akq;
+                        _a[k][q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        double apk = _a[p][k], aqk = _a[q][k];
+                        _a[p][k] = c * apk - s * aqk;
+                        _a[q][k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        double vkp = v[k][p], vkq = v[k][q];
+                        v[k][p] = c * vkp - s * vkq;
+                        v[k][q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+        //Eigenvectors are the columns of v
+        for (int i = 0; i < 3; i++) {
+            _values[i] = _a[i][i];
+            _vectors[i] = { v[0][i], v[1][i], v[2][i] };
+        }
+    }//end Eigen
+
+private:
+    double m_minOD;
+    double m_percentile;
+    ///OD vectors of the stained pixels
+    std::vector<std::array<float, 3>> m_samples;
+};//end class StainEstimator
+
+#endif
@@ -0,0 +1,108 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_STAINMATRIX_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_STAINMATRIX_H
+
+#include <array>
+#include <cmath>
+
+///A 3x3 color deconvolution matrix of stain optical density vectors (Ruifrok and Johnston)
+//
+///Each row is the normalized RGB optical density of one stain. The optical density
+///of a pixel is modelled as OD = C * M, for stain amounts C, so the amounts are
+///recovered by C = OD * inverse(M). Each stain amount is therefore a fixed weighted
+///sum of the channel optical densities.
+class StainMatrix {
+public:
+    typedef std::array<double, 3> Vector;
+
+public:
+    ///Constructor: two or three stain OD vectors. A zero third stain is completed as orthogonal to the first two.
+    StainMatrix(const Vector &_stain1, const Vector &_stain2, const Vector &_stain3 = { 0.0,0.0,0.0 }) {
+        m_stains[0] = Normalize(_stain1);
+        m_stains[1] = Normalize(_stain2);
+        m_stains[2] = (Norm(_stain3) > 0.0) ? Normalize(_stain3) 
+            : Normalize(Cross(m_stains[0], m_stains[1]));
+    }//end constructor
+
+    virtual ~StainMatrix(void) {
+    }//end destructor
+
+    ///Normalized OD vector of a stain (0 to 2)
+    inline const Vector& GetStain(const int &_stain) const { return m_stains[_stain]; }
+
+    inline bool operator==(const StainMatrix &_other) const { return m_stains == _other.m_stains; }
+    inline bool operator!=(const StainMatrix &_other) const { return !(*this == _other); }
+
+    ///Get the weights of the channel optical densities that give the amount of a stain
+    //
+    ///\return FALSE if the stain vectors are not linearly independent
+    bool GetUnmixingWeights(const int &_stain, Vector &_weights) const {
+        //Column _stain of the inverse, from the cofactors of the matrix
+        const Vector &a = m_stains[0], &b = m_stains[1], &c = m_stains[2];
+        double det = a[0] * (b[1] * c[2] - b[2] * c[1])
+                   - a[1] * (b[0] * c[2] - b[2] * c[0])
+                   + a[2] * (b[0] * c[1] - b[1] * c[0]);
+        if (std::abs(det) < 1e-12) {
+            _weights = { 0.0,0.0,0.0 };
+            return false;
+        }
+        //The columns of the inverse are the cross products of the other two rows
+        const Vector &u = m_stains[(_stain + 1) % 3], &v = m_stains[(_stain + 2) % 3];
+        Vector cross = Cross(u, v);
+        for (int ch = 0; ch < 3; ch++) {
+            _weights[ch] = cross[ch] / det;
+        }
+        return true;
+    }//end GetUnmixingWeights
+
+    ///Hematoxylin OD vector (Ruifrok and Johnston)
+    inline static Vector Hematoxylin() { return { 0.650, 0.704, 0.286 }; }
+    ///Eosin OD vector (Ruifrok and Johnston)
+    inline static Vector Eosin() { return { 0.072, 0.990, 0.105 }; }
+    ///DAB OD vector (Ruifrok and Johnston)
+    inline static Vector DAB() { return { 0.268, 0.570, 0.776 }; }
+
+    inline static double Norm(const Vector &_v) {
+        return std::sqrt(_v[0] * _v[0] + _v[1] * _v[1] + _v[2] * _v[2]);
+    }//end Norm
+
+    inline static Vector Normalize(const Vector &_v) {
+        double norm = Norm(_v);
+        return (norm > 0.0) ? Vector{ _v[0] / norm, _v[1] / norm, _v[2] / norm } : _v;
+    }//end Normalize
+
+    inline static Vector Cross(const Vector &_u, const Vector &_v) {
+        return { _u[1] * _v[2] - _u[2] * _v[1], 
+                 _u[2] * _v[0] - _u[0] * _v[2], 
+                 _u[0] * _v[1] - _u[1] * _v[0] };
+    }//end Cross
+
+private:
+    ///Stain OD vectors, one per row
+    std::array<Vector, 3> m_stains;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_TILEODSUMMARY_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_TILEODSUMMARY_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+///A compact index of the per-channel minimum and maximum RGB values of each tile of a region
+//
+///Weighted OD increases as any channel value decreases (for non-negative weights),
+///so the range of weighted OD within a tile is bounded by the weighted OD of its
+///per-channel maxima and minima. Tiles whose whole range falls on one side of the
+///threshold can be accepted or rejected without reading their pixels. The index
+///does not depend on the threshold or the weights. Ranges are stored in 8 bits, so
+///tiles with values above 255 (e.g. of 16-bit images) are not summarized, and are
+///always read.
+///
+///Only the plugin's own full-resolution passes over the region can skip tiles: the
+///mask pyramid rebuild of regions too large for IncrementalMask. The displayed tiles
+///are thresholded by the kernel, which is given source tiles at the display resolution
+///with no position in this index, so it reads every pixel.
+class TileODSummary {
+public:
+    ///Constructor: size of the region and the width and height of its tiles
+    TileODSummary(const int &_width, const int &_height, const int &_tileSize) :
+        m_tileSize(_tileSize),
+        m_tilesAcross((_width + _tileSize - 1) / _tileSize),
+        m_tilesDown((_height + _tileSize - 1) / _tileSize)
+    {
+        std::size_t numTiles = static_cast<std::size_t>(m_tilesAcross) * m_tilesDown;
+        m_ranges.assign(numTiles * 6, 0);
+        m_hasTile.assign(numTiles, false);
+    }//end constructor
+
+    virtual ~TileODSummary(void) {
+    }//end destructor
+
+    ///Get the tile column and row of a tile with its position relative to the region
+    inline int GetTileColumn(const int &_x) const { return _x / m_tileSize; }
+    inline int GetTileRow(const int &_y) const { return _y / m_tileSize; }
+
+    ///Store the per-channel RGB range of a tile; a range outside 0 to 255 leaves the tile without a summary
+    inline void SetTile(const int &_column, const int &_row, 
+        const std::array<int, 3> &_minRGB, const std::array<int, 3> &_maxRGB) {
+        std::size_t tile = GetTileIndex(_column, _row);
+        for (int ch = 0; ch < 3; ch++) {
+            if ((_minRGB[ch] < 0) || (_maxRGB[ch] > 255)) {
+                m_hasTile[tile] = false;
+                return;
+            }
+        }
+        for (int ch = 0; ch < 3; ch++) {
+            m_ranges[6 * tile + ch] = static_cast<std::uint8_t>(_minRGB[ch]);
+            m_ranges[6 * tile + 3 + ch] = static_cast<std::uint8_t>(_maxRGB[ch]);
+        }
+        m_hasTile[tile] = true;
+    }//end SetTile
+
+    ///Check whether a tile's range has been stored
+    inline bool HasTile(const int &_column, const int &_row) const {
+        return m_hasTile[GetTileIndex(_column, _row)];
+    }//end HasTile
+
+    ///Per-channel minimum RGB values of a tile
+    inline std::array<int, 3> GetMinRGB(const int &_column, const int &_row) const {
+        const std::uint8_t *range = m_ranges.data() + 6 * GetTileIndex(_column, _row);
+        return { range[0], range[1], range[2] };
+    }//end GetMinRGB
+
+    ///Per-channel maximum RGB values of a tile
+    inline std::array<int, 3> GetMaxRGB(const int &_column, const int &_row) const {
+        const std::uint8_t *range = m_ranges.data() + 6 * GetTileIndex(_column, _row);
+        return { range[3], range[4], range[5] };
+    }//end GetMaxRGB
+
+private:
+    inline std::size_t GetTileIndex(const int &_column, const int &_row) const {
+        return static_cast<std::size_t>(_row) * m_tilesAcross + _column;
+    }//end GetTileIndex
+
+private:
+    int m_tileSize;
+    int m_tilesAcross;
+    int m_tilesDown;
+    ///Minimum R, G, B then maximum R, G, B of each tile
+    std::vector<std::uint8_t> m_ranges;
+    std::vector<bool> m_hasTile;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_WHITEPOINTESTIMATOR_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_WHITEPOINTESTIMATOR_H
+
+#include <array>
+#include <vector>
+
+///Estimates the white point (I0) of each channel from the brightest pixels of a slide
+//
+///Background glass is the brightest part of a slide, so the white point of each channel
+///is taken as the mean value of that channel over the brightest pixels. Pixels are binned
+///by brightness (R + G + B) together with their per-channel sums, so a single pass of Add
+///is enough, and memory does not depend on the number of pixels.
+class WhitePointEstimator {
+public:
+    ///Constructor: the largest value of a channel, and the percentage of brightest pixels taken as background
+    WhitePointEstimator(const int &_maxValue = 255, const double &_percent = 5.0) :
+        m_maxValue(_maxValue),
+        m_percent(_percent),
+        m_numPixels(0),
+        m_counts(3 * _maxValue + 1, 0),
+        m_sums(3 * _maxValue + 1, { 0.0,0.0,0.0 })
+    {
+    }//end constructor
+
+    virtual ~WhitePointEstimator(void) {
+    }//end destructor
+
+    ///Add a pixel; values outside [0, maxValue] are clamped
+    inline void Add(const std::array<int, 3> &_rgb) {
+        std::array<int, 3> rgb;
+        for (int ch = 0; ch < 3; ch++) {
+            rgb[ch] = (_rgb[ch] < 0) ? 0 : ((_rgb[ch] > m_maxValue) ? m_maxValue : _rgb[ch]);
+        }
+        int brightness = rgb[0] + rgb[1] + rgb[2];
+        m_counts[brightness]++;
+        for (int ch = 0; ch < 3; ch++) {
+            m_sums[brightness][ch] += rgb[ch];
+        }
+        m_numPixels++;
+    }//end Add
+
+    inline long long GetNumPixels() const { return m_numPixels; }
+
+    ///Get the white point of each channel
+    //
+    ///\return FALSE if there are no pixels, or if the brightest pixels are darker than
+    ///half the scale (i.e. there is no background), in which case _whitePoint is not changed
+    bool Estimate(std::array<double, 3> &_whitePoint) const {
+        if (0 == m_numPixels) {
+            return false;
+        }
+        //Take whole brightness bins from the top until the percentage is reached
+        long long wanted = static_cast<long long>(m_percent / 100.0 * m_numPixels);
+        wanted = (wanted < 1) ? 1 : wanted;
+        long long count = 0;
+        std::array<double, 3> sums = { 0.0,0.0,0.0 };
+        for (int b = static_cast<int>(m_counts.size()) - 1; (b >= 0) && (count < wanted); b--) {
+            count += m_counts[b];
+            for (int ch = 0; ch < 3; ch++) {
+                sums[ch] += m_sums[b][ch];
+            }
+        }
+        std::array<double, 3> whitePoint;
+        for (int ch = 0; ch < 3; ch++) {
+            whitePoint[ch] = sums[ch] / count;
+            if (whitePoint[ch] < 0.5 * m_maxValue) {
+                return false;
+            }
+        }
+        _whitePoint = whitePoint;
+        return true;
+    }//end Estimate
+
+private:
+    int m_maxValue;
+    double m_percent;
+    long long m_numPixels;
+    ///Number of pixels of each brightness (R + G + B)
+    std::vector<long long> m_counts;
+    ///Sums of the R, G and B values of the pixels of each brightness
+    std::vector<std::array<double, 3>> m_sums;
+};//end class WhitePointEstimator
+
+#endif
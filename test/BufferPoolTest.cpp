@@ -0,0 +1,118 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//BufferPool: buffers returned to their size class and reused, capped free lists, and leases on several threads
+
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+#include "TestCheck.h"
+
+namespace {
+
+void TestReuse() {
+    BufferPool pool;
+    const std::uint8_t *first = nullptr;
+    {
+        BufferPool::Lease lease = pool.Acquire(5000);
+        CHECK(5000 == lease.Get().size());
+        CHECK(8192 == lease.Get().capacity());
+        first = lease.Get().data();
+        CHECK(1 == pool.GetStats().leasedBuffers);
+    }
+    BufferPool::Stats stats = pool.GetStats();
+    CHECK(0 == stats.leasedBuffers);
+    CHECK(1 == stats.freeBuffers);
+    CHECK(8192 == stats.freeBytes);
+    //A smaller request of the same size class gets the same memory back
+    BufferPool::Lease again = pool.Acquire(6000);
+    CHECK(first == again.Get().data());
+    CHECK(6000 == again.Get().size());
+    stats = pool.GetStats();
+    CHECK(1 == stats.hits);
+    CHECK(1 == stats.misses);
+    CHECK(0 == stats.freeBuffers);
+}//end TestReuse
+
+void TestSizeClasses() {
+    BufferPool pool;
+    {
+        BufferPool::Lease small = pool.Acquire(0);
+        BufferPool::Lease large = pool.Acquire(100000);
+        CHECK(4096 == small.Get().capacity());
+        CHECK(131072 == large.Get().capacity());
+    }
+    //A buffer of another class is not handed out
+    BufferPool::Lease other = pool.Acquire(20000);
+    CHECK(32768 == other.Get().capacity());
+    CHECK(0 == pool.GetStats().hits);
+    CHECK(2 == pool.GetStats().freeBuffers);
+    pool.Clear();
+    CHECK(0 == pool.GetStats().freeBuffers);
+    CHECK(0 == pool.GetStats().freeBytes);
+}//end TestSizeClasses
+
+void TestMaxPerClass() {
+    BufferPool pool(2);
+    {
+        std::vector<BufferPool::Lease> leases;
+        for (int i = 0; i < 5; i++) {
+            leases.push_back(pool.Acquire(1000));
+        }
+        CHECK(5 == pool.GetStats().leasedBuffers);
+    }
+    CHECK(2 == pool.GetStats().freeBuffers);
+    CHECK(0 == pool.GetStats().leasedBuffers);
+}//end TestMaxPerClass
+
+void TestThreads() {
+    BufferPool pool(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&pool, t]() {
+            for (int i = 0; i < 1000; i++) {
+                BufferPool::Lease lease = pool.Acquire(4096 * (1 + (i + t) % 3));
+                lease.Get()[0] = static_cast<std::uint8_t>(t);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    BufferPool::Stats stats = pool.GetStats();
+    CHECK(0 == stats.leasedBuffers);
+    CHECK(4000 == stats.hits + stats.misses);
+    CHECK(stats.freeBuffers <= 12);
+}//end TestThreads
+
+}//end namespace
+
+int main() {
+    TestReuse();
+    TestSizeClasses();
+    TestMaxPerClass();
+    TestThreads();
+    return TestResult();
+}//end main
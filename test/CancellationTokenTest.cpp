@@ -0,0 +1,86 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//CancellationToken: generations, and jobs on other threads that stop once cancelled
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "CancellationToken.h"
+#include "TestCheck.h"
+
+namespace {
+
+void TestGenerations() {
+    CancellationToken token;
+    std::uint64_t first = token.GetGeneration();
+    CHECK(!token.IsCancelled(first));
+    std::uint64_t second = token.Cancel();
+    CHECK(second == token.GetGeneration());
+    CHECK(second != first);
+    CHECK(token.IsCancelled(first));
+    CHECK(!token.IsCancelled(second));
+    //Every earlier generation stays stale
+    token.Cancel();
+    CHECK(token.IsCancelled(first));
+    CHECK(token.IsCancelled(second));
+    CHECK(CancellationToken::GetCheckRows() > 0);
+}//end TestGenerations
+
+void TestJobsStop() {
+    CancellationToken token;
+    std::uint64_t generation = token.GetGeneration();
+    std::atomic<int> started(0), stopped(0);
+    std::vector<std::thread> jobs;
+    for (int t = 0; t < 4; t++) {
+        jobs.emplace_back([&]() {
+            started++;
+            //Poll as a tile would between rows, until the work is stale
+            while (!token.IsCancelled(generation)) {
+                std::this_thread::yield();
+            }
+            stopped++;
+        });
+    }
+    while (started < 4) {
+        std::this_thread::yield();
+    }
+    token.Cancel();
+    for (auto &job : jobs) {
+        job.join();
+    }
+    CHECK(4 == stopped);
+    //Work started after the cancel is not stale
+    CHECK(!token.IsCancelled(token.GetGeneration()));
+}//end TestJobsStop
+
+}//end namespace
+
+int main() {
+    TestGenerations();
+    TestJobsStop();
+    return TestResult();
+}//end main
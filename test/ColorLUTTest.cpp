@@ -0,0 +1,97 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//ColorLUT: tables built from a rule on any number of threads, and trained from labeled samples
+
+#include <array>
+#include <vector>
+
+#include "ColorLUT.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Retains colors whose red is above blue, and those with an odd green
+bool Rule(int r, int g, int b) {
+    return (r > b) || (1 == (g & 1));
+}//end Rule
+
+///Every color of the table agrees with the rule
+bool MatchesRule(const ColorLUT &_lut) {
+    for (int r = 0; r < 256; r++) {
+        for (int g = 0; g < 256; g++) {
+            for (int b = 0; b < 256; b++) {
+                if (_lut.IsRetained(r, g, b) != Rule(r, g, b)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}//end MatchesRule
+
+void TestBuild() {
+    for (int threads : { 1, 3, 8, 300 }) {
+        ColorLUT lut;
+        lut.Build(Rule, threads);
+        CHECK(MatchesRule(lut));
+    }
+}//end TestBuild
+
+void TestTrain() {
+    //Reddish samples are retained, bluish ones rejected
+    std::vector<std::array<int, 3>> retained = { { 200, 40, 40 }, { 180, 60, 50 }, { 220, 30, 60 } };
+    std::vector<std::array<int, 3>> rejected = { { 40, 40, 200 }, { 60, 50, 180 } };
+    ColorLUT lut;
+    lut.Train(retained, rejected, 2);
+    for (const auto &rgb : retained) { CHECK(lut.IsRetained(rgb[0], rgb[1], rgb[2])); }
+    for (const auto &rgb : rejected) { CHECK(!lut.IsRetained(rgb[0], rgb[1], rgb[2])); }
+    //Colors without samples take the decision of the nearest sampled cell
+    CHECK(lut.IsRetained(255, 0, 0));
+    CHECK(!lut.IsRetained(0, 0, 255));
+    //Values in the same cell of 4 share a decision
+    CHECK(lut.IsRetained(203, 43, 43));
+}//end TestTrain
+
+void TestTrainTies() {
+    ColorLUT lut;
+    //A tie leaves the cell undecided, so it takes a neighbor's decision
+    std::vector<std::array<int, 3>> retained = { { 100, 100, 100 }, { 108, 100, 100 } };
+    std::vector<std::array<int, 3>> rejected = { { 100, 100, 100 }, { 20, 100, 100 } };
+    lut.Train(retained, rejected);
+    CHECK(lut.IsRetained(100, 100, 100));
+    //No samples rejects every color
+    lut.Train({}, {});
+    CHECK(!lut.IsRetained(100, 100, 100));
+    CHECK(!lut.IsRetained(255, 255, 255));
+}//end TestTrainTies
+
+}//end namespace
+
+int main() {
+    TestBuild();
+    TestTrain();
+    TestTrainTies();
+    return TestResult();
+}//end main
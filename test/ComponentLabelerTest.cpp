@@ -0,0 +1,175 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//Seam merging of ComponentLabeler: labeling tile by tile matches labeling the whole mask
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "ComponentLabeler.h"
+#include "TestCheck.h"
+
+namespace {
+
+typedef std::tuple<std::int64_t, int, int, int, int, std::int64_t, double, double> ComponentKey;
+
+///The measurements of a component, in a form that sorts and compares
+ComponentKey MakeKey(const ComponentLabeler::Component &_c) {
+    return ComponentKey(_c.area, _c.minX, _c.minY, _c.maxX, _c.maxY, _c.perimeter, _c.sumX, _c.sumY);
+}//end MakeKey
+
+///Random mask with the given fraction of foreground pixels
+std::vector<std::uint8_t> RandomMask(const int &_width, const int &_height, const double &_density,
+    std::mt19937 &_random) {
+    std::bernoulli_distribution foreground(_density);
+    std::vector<std::uint8_t> mask(static_cast<std::size_t>(_width) * _height);
+    for (auto &m : mask) { m = foreground(_random) ? 1 : 0; }
+    return mask;
+}//end RandomMask
+
+///Components of the whole mask by flood fill, 8-connected, with 4-neighbor perimeters
+std::vector<ComponentKey> FloodFill(const std::vector<std::uint8_t> &_mask, const int &_width, const int &_height) {
+    auto isSet = [&](int x, int y) {
+        return (x >= 0) && (y >= 0) && (x < _width) && (y < _height) && (0 != _mask[y*_width + x]);
+    };
+    std::vector<bool> visited(_mask.size(), false);
+    std::vector<ComponentKey> result;
+    for (int start = 0; start < static_cast<int>(_mask.size()); start++) {
+        if ((0 == _mask[start]) || visited[start]) { continue; }
+        ComponentLabeler::Component c = { 0, 0.0, 0.0, _width, _height, -1, -1, 0 };
+        std::vector<int> stack(1, start);
+        visited[start] = true;
+        while (!stack.empty()) {
+            int index = stack.back();
+            stack.pop_back();
+            int x = index % _width;
+            int y = index / _width;
+            c.area++;
+            c.sumX += x;
+            c.sumY += y;
+            c.minX = std::min(c.minX, x);
+            c.minY = std::min(c.minY, y);
+            c.maxX = std::max(c.maxX, x);
+            c.maxY = std::max(c.maxY, y);
+            c.perimeter += (isSet(x - 1, y) ? 0 : 1) + (isSet(x + 1, y) ? 0 : 1)
+                + (isSet(x, y - 1) ? 0 : 1) + (isSet(x, y + 1) ? 0 : 1);
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (isSet(x + dx, y + dy) && !visited[(y + dy)*_width + x + dx]) {
+                        visited[(y + dy)*_width + x + dx] = true;
+                        stack.push_back((y + dy)*_width + x + dx);
+                    }
+                }
+            }
+        }
+        result.push_back(MakeKey(c));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}//end FloodFill
+
+///Components found by adding the mask in tiles of the given size, in raster order
+std::vector<ComponentKey> LabelTiled(const std::vector<std::uint8_t> &_mask, const int &_width, const int &_height,
+    const int &_tileWidth, const int &_tileHeight) {
+    std::vector<ComponentKey> result;
+    ComponentLabeler labeler(_width, [&](const ComponentLabeler::Component &c) { result.push_back(MakeKey(c)); });
+    for (int y = 0; y < _height; y += _tileHeight) {
+        int h = std::min(_tileHeight, _height - y);
+        for (int x = 0; x < _width; x += _tileWidth) {
+            int w = std::min(_tileWidth, _width - x);
+            std::vector<std::uint8_t> tile(static_cast<std::size_t>(w) * h);
+            for (int ty = 0; ty < h; ty++) {
+                std::copy_n(_mask.begin() + (y + ty)*_width + x, w, tile.begin() + ty*w);
+            }
+            labeler.AddTile(x, y, w, h, tile);
+        }
+    }
+    labeler.Finish();
+    std::sort(result.begin(), result.end());
+    return result;
+}//end LabelTiled
+
+///Random masks, across densities on both sides of the percolation threshold and several tile shapes
+void TestRandomMasks() {
+    std::mt19937 random(12345);
+    const int width = 53, height = 41;
+    const int tileSizes[][2] = { { 1, 1 }, { 2, 3 }, { 5, 4 }, { 7, 7 }, { 16, 9 }, { 53, 41 }, { 53, 1 }, { 1, 41 } };
+    for (double density : { 0.1, 0.3, 0.45, 0.6, 0.9 }) {
+        for (int trial = 0; trial < 4; trial++) {
+            auto mask = RandomMask(width, height, density, random);
+            auto expected = FloodFill(mask, width, height);
+            for (const auto &tileSize : tileSizes) {
+                CHECK(LabelTiled(mask, width, height, tileSize[0], tileSize[1]) == expected);
+            }
+        }
+    }
+}//end TestRandomMasks
+
+///Components that touch only at a corner are joined across a tile corner
+void TestDiagonalAcrossCorners() {
+    const int width = 12, height = 12;
+    std::vector<std::uint8_t> forward(width * height, 0), backward(width * height, 0);
+    for (int i = 0; i < width; i++) {
+        forward[i*width + i] = 1;
+        backward[i*width + width - 1 - i] = 1;
+    }
+    for (const auto &mask : { forward, backward }) {
+        auto components = LabelTiled(mask, width, height, 4, 4);
+        CHECK(1 == components.size());
+        CHECK(components == FloodFill(mask, width, height));
+    }
+}//end TestDiagonalAcrossCorners
+
+///A U shape whose arms start in separate tiles only joins in a later tile row
+void TestLateMerge() {
+    const int width = 10, height = 9;
+    std::vector<std::uint8_t> mask(width * height, 0);
+    for (int y = 0; y < height; y++) {
+        mask[y*width + 1] = 1;
+        mask[y*width + 8] = 1;
+    }
+    for (int x = 1; x <= 8; x++) { mask[(height - 1)*width + x] = 1; }
+    auto components = LabelTiled(mask, width, height, 5, 3);
+    CHECK(1 == components.size());
+    CHECK(components == FloodFill(mask, width, height));
+}//end TestLateMerge
+
+///An empty mask reports nothing
+void TestEmptyMask() {
+    std::vector<std::uint8_t> mask(20 * 10, 0);
+    CHECK(LabelTiled(mask, 20, 10, 8, 8).empty());
+}//end TestEmptyMask
+
+}//end namespace
+
+int main() {
+    TestRandomMasks();
+    TestDiagonalAcrossCorners();
+    TestLateMerge();
+    TestEmptyMask();
+    return TestResult();
+}//end main
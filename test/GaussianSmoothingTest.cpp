@@ -0,0 +1,145 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//GaussianSmoothing: the blur's weights, and tiles with a halo matching the whole image
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "GaussianSmoothing.h"
+#include "TestCheck.h"
+
+namespace {
+
+typedef GaussianSmoothing::ODPixel ODPixel;
+
+///Random channel ODs between 0 and 3
+std::vector<ODPixel> RandomImage(const int &_width, const int &_height, std::mt19937 &_random) {
+    std::uniform_real_distribution<float> od(0.0f, 3.0f);
+    std::vector<ODPixel> image(static_cast<std::size_t>(_width) * _height);
+    for (auto &p : image) { p = { od(_random), od(_random), od(_random) }; }
+    return image;
+}//end RandomImage
+
+///The blur of a single pixel away from the edges is the product of two normalized 1D Gaussians
+void TestImpulseResponse() {
+    const double sigma = 1.5;
+    GaussianSmoothing smoothing(sigma);
+    const int radius = smoothing.GetRadius();
+    CHECK(5 == radius);
+    const int size = 4 * radius + 1, center = 2 * radius;
+    std::vector<ODPixel> image(size * size, ODPixel{ 0.0f, 0.0f, 0.0f });
+    image[center*size + center] = { 1.0f, 2.0f, 0.0f };
+    smoothing.Apply(image, size, size);
+
+    double norm = 0.0;
+    for (int k = -radius; k <= radius; k++) { norm += std::exp(-0.5 * k * k / (sigma * sigma)); }
+    double total = 0.0;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int dx = x - center, dy = y - center;
+            double expected = 0.0;
+            if ((std::abs(dx) <= radius) && (std::abs(dy) <= radius)) {
+                expected = std::exp(-0.5 * (dx * dx + dy * dy) / (sigma * sigma)) / (norm * norm);
+            }
+            CHECK_NEAR(image[y*size + x][0], expected, 1e-6);
+            CHECK_NEAR(image[y*size + x][1], 2.0 * expected, 2e-6);
+            CHECK_NEAR(image[y*size + x][2], 0.0, 1e-12);
+            total += image[y*size + x][0];
+        }
+    }
+    CHECK_NEAR(total, 1.0, 1e-5);
+}//end TestImpulseResponse
+
+///Renormalized weights keep a constant image constant, edges included
+void TestConstantImage() {
+    const int width = 23, height = 9;
+    std::vector<ODPixel> image(width * height, ODPixel{ 0.25f, 1.0f, 2.5f });
+    GaussianSmoothing(2.0).Apply(image, width, height);
+    for (const auto &p : image) {
+        CHECK_NEAR(p[0], 0.25f, 1e-5f);
+        CHECK_NEAR(p[1], 1.0f, 1e-5f);
+        CHECK_NEAR(p[2], 2.5f, 1e-5f);
+    }
+}//end TestConstantImage
+
+///A tile cut out with GetRadius() pixels around it gives the whole image's blur in the tile
+void TestTileWithHalo() {
+    std::mt19937 random(42);
+    const int width = 97, height = 61, tileSize = 24;
+    for (double sigma : { 0.5, 1.0, 2.7 }) {
+        GaussianSmoothing smoothing(sigma);
+        auto image = RandomImage(width, height, random);
+        auto whole = image;
+        smoothing.Apply(whole, width, height);
+        int halo = smoothing.GetRadius();
+        for (int y = 0; y < height; y += tileSize) {
+            for (int x = 0; x < width; x += tileSize) {
+                int x0 = std::max(0, x - halo), y0 = std::max(0, y - halo);
+                int x1 = std::min(width, x + tileSize + halo), y1 = std::min(height, y + tileSize + halo);
+                int w = x1 - x0, h = y1 - y0;
+                std::vector<ODPixel> tile(static_cast<std::size_t>(w) * h);
+                for (int ty = 0; ty < h; ty++) {
+                    std::copy_n(image.begin() + (y0 + ty)*width + x0, w, tile.begin() + ty*w);
+                }
+                smoothing.Apply(tile, w, h);
+                float maxError = 0.0f;
+                for (int gy = y; gy < std::min(height, y + tileSize); gy++) {
+                    for (int gx = x; gx < std::min(width, x + tileSize); gx++) {
+                        for (int c = 0; c < 3; c++) {
+                            maxError = std::max(maxError,
+                                std::abs(tile[(gy - y0)*w + gx - x0][c] - whole[gy*width + gx][c]));
+                        }
+                    }
+                }
+                CHECK_NEAR(maxError, 0.0f, 1e-5f);
+            }
+        }
+    }
+}//end TestTileWithHalo
+
+///Below the minimum sigma the blur is off and needs no halo
+void TestInactive() {
+    std::mt19937 random(1);
+    GaussianSmoothing smoothing(0.3);
+    CHECK(!smoothing.IsActive());
+    CHECK(0 == smoothing.GetRadius());
+    auto image = RandomImage(10, 10, random);
+    auto original = image;
+    smoothing.Apply(image, 10, 10);
+    CHECK(image == original);
+    CHECK(GaussianSmoothing(GaussianSmoothing::GetMinSigma()).IsActive());
+}//end TestInactive
+
+}//end namespace
+
+int main() {
+    TestImpulseResponse();
+    TestConstantImage();
+    TestTileWithHalo();
+    TestInactive();
+    return TestResult();
+}//end main
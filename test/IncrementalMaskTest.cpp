@@ -0,0 +1,140 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//IncrementalMask: moving the threshold flips exactly the pixels a full recount would
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "IncrementalMask.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Whether a key is in a retained range
+inline bool InRange(const int &_key, const IncrementalMask::KeyRange &_range) {
+    return (_key >= _range.first) && (_key < _range.second);
+}//end InRange
+
+///Random thresholds up and down, and switches of behavior, against recounting every pixel
+void TestMovingThreshold() {
+    std::mt19937 random(31);
+    const int width = 53, height = 37, tileSize = 16;
+    //Keys clustered in a narrow OD range, so that many pixels share a key
+    std::uniform_real_distribution<double> od(0.0, 1.5);
+    std::vector<int> keys(width * height);
+    for (auto &k : keys) { k = IncrementalMask::QuantizeOD(std::round(od(random) * 200.0) / 200.0); }
+
+    IncrementalMask index(width, height, tileSize);
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            int w = std::min(tileSize, width - x), h = std::min(tileSize, height - y);
+            CHECK(false == index.IsComplete());
+            std::vector<std::uint16_t> tile(w * h);
+            for (int ty = 0; ty < h; ty++) {
+                for (int tx = 0; tx < w; tx++) {
+                    tile[ty*w + tx] = static_cast<std::uint16_t>(keys[(y + ty)*width + x + tx]);
+                }
+            }
+            //A reused buffer may be longer than the tile
+            tile.resize(tile.size() + 7, 0);
+            index.SetTile(x, y, w, h, tile);
+        }
+    }
+    CHECK(index.IsComplete());
+
+    IncrementalMask::KeyRange range = IncrementalMask::GetRetainedRange(0.5, true);
+    std::vector<int> mask(keys.size());
+    for (std::size_t px = 0; px < keys.size(); px++) { mask[px] = InRange(keys[px], range) ? 1 : 0; }
+
+    std::uniform_real_distribution<double> threshold(-0.1, 1.7);
+    std::bernoulli_distribution higher(0.7);
+    bool same = true, flipsValid = true;
+    for (int step = 0; step < 200; step++) {
+        IncrementalMask::KeyRange next = IncrementalMask::GetRetainedRange(threshold(random), higher(random));
+        index.ForEachChangedPixel(range, next, [&](int x, int y, int delta) {
+            int &m = mask[y*width + x];
+            //Each pixel flips once, and in the direction of its current state
+            flipsValid = flipsValid && (((1 == delta) && (0 == m)) || ((-1 == delta) && (1 == m)));
+            m += delta;
+        });
+        range = next;
+        for (std::size_t px = 0; px < keys.size(); px++) {
+            same = same && (mask[px] == (InRange(keys[px], range) ? 1 : 0));
+        }
+    }
+    CHECK(flipsValid);
+    CHECK(same);
+}//end TestMovingThreshold
+
+///Every pixel of a key range is visited once, at its position in the region
+void TestPixelsInRange() {
+    const int width = 10, height = 6, tileSize = 4;
+    IncrementalMask index(width, height, tileSize);
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            int w = std::min(tileSize, width - x), h = std::min(tileSize, height - y);
+            std::vector<std::uint16_t> tile(w * h);
+            //The key of a pixel is its position in the region
+            for (int ty = 0; ty < h; ty++) {
+                for (int tx = 0; tx < w; tx++) { tile[ty*w + tx] = static_cast<std::uint16_t>((y + ty)*width + x + tx); }
+            }
+            index.SetTile(x, y, w, h, tile);
+        }
+    }
+    std::vector<int> visits(width * height, 0);
+    bool positioned = true;
+    index.ForEachPixelInRange(IncrementalMask::KeyRange(13, 47), [&](int x, int y) {
+        visits[y*width + x]++;
+    });
+    for (int px = 0; px < width * height; px++) {
+        positioned = positioned && (visits[px] == (((px >= 13) && (px < 47)) ? 1 : 0));
+    }
+    CHECK(positioned);
+}//end TestPixelsInRange
+
+///Keys and retained ranges of threshold values
+void TestKeys() {
+    CHECK(0 == IncrementalMask::QuantizeOD(-0.5));
+    CHECK(5000 == IncrementalMask::QuantizeOD(0.5));
+    CHECK(IncrementalMask::GetMaxKey() == IncrementalMask::QuantizeOD(100.0));
+    //Both behaviors retain a value exactly at the threshold
+    int key = IncrementalMask::QuantizeOD(0.25);
+    CHECK(InRange(key, IncrementalMask::GetRetainedRange(0.25, true)));
+    CHECK(InRange(key, IncrementalMask::GetRetainedRange(0.25, false)));
+    CHECK(!InRange(key, IncrementalMask::GetRetainedRange(0.2501, true)));
+    CHECK(!InRange(key, IncrementalMask::GetRetainedRange(0.2499, false)));
+}//end TestKeys
+
+}//end namespace
+
+int main() {
+    TestMovingThreshold();
+    TestPixelsInRange();
+    TestKeys();
+    return TestResult();
+}//end main
@@ -0,0 +1,100 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//IntegralHistogram: rectangle queries match summing the cell histograms directly
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "IntegralHistogram.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Every rectangle of cells and every bin, against the sum of the cell histograms
+void TestRectanglesMatchCells() {
+    std::mt19937 random(99);
+    const int across = 7, down = 5, numBins = 20;
+    const double maxOD = 2.0;
+    //Values beyond the maximum OD land in the overflow bin
+    std::uniform_real_distribution<double> od(0.0, 1.2 * maxOD);
+    std::uniform_int_distribution<int> numValues(0, 40);
+
+    std::vector<ODHistogram> cells(across * down, ODHistogram(maxOD, numBins));
+    IntegralHistogram table(across, down, maxOD, numBins);
+    for (int r = 0; r < down; r++) {
+        for (int c = 0; c < across; c++) {
+            ODHistogram &cell = cells[r*across + c];
+            for (int n = numValues(random); n > 0; n--) { cell.Add(od(random)); }
+            table.SetCell(c, r, cell);
+        }
+    }
+    table.Build();
+
+    bool same = true;
+    for (int r0 = 0; r0 <= down; r0++) {
+        for (int r1 = r0; r1 <= down; r1++) {
+            for (int c0 = 0; c0 <= across; c0++) {
+                for (int c1 = c0; c1 <= across; c1++) {
+                    std::int64_t total = 0;
+                    std::vector<std::int64_t> atOrAbove(numBins + 1, 0);
+                    for (int r = r0; r < r1; r++) {
+                        for (int c = c0; c < c1; c++) {
+                            const ODHistogram &cell = cells[r*across + c];
+                            total += cell.GetTotalCount();
+                            for (int bin = 0; bin <= numBins; bin++) {
+                                for (int b = bin; b <= numBins; b++) { atOrAbove[bin] += cell.GetCount(b); }
+                            }
+                        }
+                    }
+                    same = same && (table.GetCount(c0, r0, c1, r1) == total);
+                    for (int bin = 0; bin <= numBins; bin++) {
+                        same = same && (table.GetCountAtOrAbove(c0, r0, c1, r1, bin) == atOrAbove[bin]);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(same);
+}//end TestRectanglesMatchCells
+
+///The table uses the bins of the cell histograms
+void TestBinning() {
+    IntegralHistogram table(2, 2, 1.5, 30);
+    ODHistogram histogram(1.5, 30);
+    CHECK(30 == table.GetNumBins());
+    CHECK(2 == table.GetCellsAcross() && 2 == table.GetCellsDown());
+    for (double od : { 0.0, 0.049, 0.05, 0.75, 1.49, 1.5, 4.0 }) {
+        CHECK(table.GetBinIndex(od) == histogram.GetBinIndex(od));
+    }
+}//end TestBinning
+
+}//end namespace
+
+int main() {
+    TestRectanglesMatchCells();
+    TestBinning();
+    return TestResult();
+}//end main
@@ -0,0 +1,172 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//LocalThreshold: window statistics, tiles with a halo matching the whole image, and values at the threshold
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "LocalThreshold.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Random weighted ODs from 0 to 2 in steps of 1/64, whose sums and squares are exact in double
+std::vector<float> RandomImage(const int &_width, const int &_height, std::mt19937 &_random) {
+    std::uniform_int_distribution<int> steps(0, 128);
+    std::vector<float> image(static_cast<std::size_t>(_width) * _height);
+    for (auto &v : image) { v = steps(_random) / 64.0f; }
+    return image;
+}//end RandomImage
+
+///The mask from the mean and standard deviation of each clipped window, summed directly
+std::vector<std::uint8_t> NaiveApply(const LocalThreshold &_local, const std::vector<float> &_wod,
+    const int &_width, const int &_height, const int &_radius, const bool &_retainHigher) {
+    std::vector<std::uint8_t> mask(_wod.size(), 0);
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            double sum = 0.0, squares = 0.0, n = 0.0;
+            for (int yy = std::max(0, y - _radius); yy <= std::min(_height - 1, y + _radius); yy++) {
+                for (int xx = std::max(0, x - _radius); xx <= std::min(_width - 1, x + _radius); xx++) {
+                    double v = _wod[yy*_width + xx];
+                    sum += v;
+                    squares += v * v;
+                    n += 1.0;
+                }
+            }
+            double mean = sum / n;
+            double threshold = _local.GetThreshold(mean, std::sqrt(std::max(0.0, squares / n - mean * mean)));
+            double v = _wod[y*_width + x];
+            mask[y*_width + x] = (_retainHigher ? (v >= threshold) : (v <= threshold)) ? 1 : 0;
+        }
+    }
+    return mask;
+}//end NaiveApply
+
+const LocalThreshold::Method methods[] = { LocalThreshold::NIBLACK, LocalThreshold::SAUVOLA };
+
+///The integral images give the same windows as summing them directly
+void TestMatchesNaive() {
+    std::mt19937 random(17);
+    const int width = 41, height = 23;
+    for (auto method : methods) {
+        for (int radius : { 1, 4, 30 }) {
+            for (bool retainHigher : { true, false }) {
+                LocalThreshold local(method, radius, 0.3, 0.5);
+                auto image = RandomImage(width, height, random);
+                std::vector<std::uint8_t> mask;
+                local.Apply(image, width, height, retainHigher, mask);
+                CHECK(mask == NaiveApply(local, image, width, height, radius, retainHigher));
+            }
+        }
+    }
+}//end TestMatchesNaive
+
+///A tile cut out with GetRadius() pixels around it gives the whole image's mask in the tile
+void TestTileWithHalo() {
+    std::mt19937 random(23);
+    const int width = 120, height = 75, tileSize = 32;
+    for (auto method : methods) {
+        for (int radius : { 2, 9, 16 }) {
+            for (bool retainHigher : { true, false }) {
+                LocalThreshold local(method, radius, -0.2, 0.5);
+                auto image = RandomImage(width, height, random);
+                std::vector<std::uint8_t> whole;
+                local.Apply(image, width, height, retainHigher, whole);
+                int halo = local.GetRadius();
+                CHECK(radius == halo);
+                for (int y = 0; y < height; y += tileSize) {
+                    for (int x = 0; x < width; x += tileSize) {
+                        int x0 = std::max(0, x - halo), y0 = std::max(0, y - halo);
+                        int x1 = std::min(width, x + tileSize + halo), y1 = std::min(height, y + tileSize + halo);
+                        int w = x1 - x0, h = y1 - y0;
+                        std::vector<float> tile(static_cast<std::size_t>(w) * h);
+                        for (int ty = 0; ty < h; ty++) {
+                            std::copy_n(image.begin() + (y0 + ty)*width + x0, w, tile.begin() + ty*w);
+                        }
+                        std::vector<std::uint8_t> tileMask;
+                        local.Apply(tile, w, h, retainHigher, tileMask);
+                        bool same = true;
+                        for (int gy = y; gy < std::min(height, y + tileSize); gy++) {
+                            for (int gx = x; gx < std::min(width, x + tileSize); gx++) {
+                                same = same && (tileMask[(gy - y0)*w + gx - x0] == whole[gy*width + gx]);
+                            }
+                        }
+                        CHECK(same);
+                    }
+                }
+            }
+        }
+    }
+}//end TestTileWithHalo
+
+///With k = 0 a flat window's threshold is its value, which either behavior retains, as the global threshold does
+void TestValueAtThreshold() {
+    const int width = 16, height = 9;
+    std::vector<float> flat(width * height, 0.75f);
+    for (auto method : methods) {
+        LocalThreshold local(method, 3, 0.0, 0.5);
+        for (bool retainHigher : { true, false }) {
+            std::vector<std::uint8_t> mask;
+            local.Apply(flat, width, height, retainHigher, mask);
+            CHECK(std::count(mask.begin(), mask.end(), 1) == width * height);
+        }
+    }
+    //A value just past the threshold is retained by one behavior only
+    std::vector<float> step(flat);
+    step[4*width + 8] = 0.8f;
+    LocalThreshold niblack(LocalThreshold::NIBLACK, 0, 0.0);
+    CHECK(!niblack.IsActive());
+    LocalThreshold local(LocalThreshold::NIBLACK, 1, 0.0);
+    std::vector<std::uint8_t> higher, lower;
+    local.Apply(step, width, height, true, higher);
+    local.Apply(step, width, height, false, lower);
+    CHECK(1 == higher[4*width + 8] && 0 == lower[4*width + 8]);
+    CHECK(0 == higher[4*width + 7] && 1 == lower[4*width + 7]);
+}//end TestValueAtThreshold
+
+///An inactive threshold needs no halo and retains nothing
+void TestInactive() {
+    LocalThreshold none(LocalThreshold::NONE, 5, 0.2);
+    CHECK(!none.IsActive());
+    CHECK(0 == none.GetRadius());
+    std::vector<float> image(30, 1.0f);
+    std::vector<std::uint8_t> mask(3, 1);
+    none.Apply(image, 6, 5, true, mask);
+    CHECK(30 == mask.size());
+    CHECK(std::count(mask.begin(), mask.end(), 0) == 30);
+}//end TestInactive
+
+}//end namespace
+
+int main() {
+    TestMatchesNaive();
+    TestTileWithHalo();
+    TestValueAtThreshold();
+    TestInactive();
+    return TestResult();
+}//end main
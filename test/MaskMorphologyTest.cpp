@@ -0,0 +1,171 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//MaskMorphology: the packed passes match a per-pixel square window, and tiles with a halo match the whole image
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "MaskMorphology.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Random mask with the given fraction of foreground pixels
+std::vector<std::uint8_t> RandomMask(const int &_width, const int &_height, const double &_density,
+    std::mt19937 &_random) {
+    std::bernoulli_distribution foreground(_density);
+    std::vector<std::uint8_t> mask(static_cast<std::size_t>(_width) * _height);
+    for (auto &m : mask) { m = foreground(_random) ? 1 : 0; }
+    return mask;
+}//end RandomMask
+
+///Erosion or dilation one pixel at a time, ignoring the window outside the mask
+std::vector<std::uint8_t> NaivePass(const std::vector<std::uint8_t> &_mask, const int &_width, const int &_height,
+    const int &_radius, const bool &_erode) {
+    std::vector<std::uint8_t> result(_mask.size());
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            bool value = _erode;
+            for (int yy = std::max(0, y - _radius); yy <= std::min(_height - 1, y + _radius); yy++) {
+                for (int xx = std::max(0, x - _radius); xx <= std::min(_width - 1, x + _radius); xx++) {
+                    bool set = (0 != _mask[yy*_width + xx]);
+                    value = _erode ? (value && set) : (value || set);
+                }
+            }
+            result[y*_width + x] = value ? 1 : 0;
+        }
+    }
+    return result;
+}//end NaivePass
+
+std::vector<std::uint8_t> NaiveApply(const std::vector<std::uint8_t> &_mask, const int &_width, const int &_height,
+    const MaskMorphology::Operation &_operation, const int &_radius) {
+    switch (_operation) {
+    case MaskMorphology::ERODE:
+        return NaivePass(_mask, _width, _height, _radius, true);
+    case MaskMorphology::DILATE:
+        return NaivePass(_mask, _width, _height, _radius, false);
+    case MaskMorphology::OPEN:
+        return NaivePass(NaivePass(_mask, _width, _height, _radius, true), _width, _height, _radius, false);
+    case MaskMorphology::CLOSE:
+        return NaivePass(NaivePass(_mask, _width, _height, _radius, false), _width, _height, _radius, true);
+    default:
+        return _mask;
+    }
+}//end NaiveApply
+
+const MaskMorphology::Operation operations[] = { MaskMorphology::ERODE, MaskMorphology::DILATE,
+    MaskMorphology::OPEN, MaskMorphology::CLOSE };
+
+///Widths around the 64-pixel word boundary, and radii up to a whole word
+void TestMatchesNaive() {
+    std::mt19937 random(2021);
+    for (int width : { 1, 13, 63, 64, 65, 130 }) {
+        for (int radius : { 1, 2, 5, 64, 70 }) {
+            for (auto operation : operations) {
+                const int height = 17;
+                auto mask = RandomMask(width, height, 0.6, random);
+                auto expected = NaiveApply(mask, width, height, operation, radius);
+                MaskMorphology(operation, radius).Apply(mask, width, height);
+                CHECK(mask == expected);
+            }
+        }
+    }
+}//end TestMatchesNaive
+
+///A tile cut out with GetHalo() pixels around it gives the whole image's result in the tile
+void TestTileWithHalo() {
+    std::mt19937 random(7);
+    const int width = 150, height = 90, tileSize = 32;
+    for (int radius : { 1, 3, 8 }) {
+        for (auto operation : operations) {
+            MaskMorphology morphology(operation, radius);
+            auto mask = RandomMask(width, height, 0.55, random);
+            auto whole = mask;
+            morphology.Apply(whole, width, height);
+            int halo = morphology.GetHalo();
+            for (int y = 0; y < height; y += tileSize) {
+                for (int x = 0; x < width; x += tileSize) {
+                    int x0 = std::max(0, x - halo), y0 = std::max(0, y - halo);
+                    int x1 = std::min(width, x + tileSize + halo), y1 = std::min(height, y + tileSize + halo);
+                    int w = x1 - x0, h = y1 - y0;
+                    std::vector<std::uint8_t> tile(static_cast<std::size_t>(w) * h);
+                    for (int ty = 0; ty < h; ty++) {
+                        std::copy_n(mask.begin() + (y0 + ty)*width + x0, w, tile.begin() + ty*w);
+                    }
+                    morphology.Apply(tile, w, h);
+                    bool same = true;
+                    for (int gy = y; gy < std::min(height, y + tileSize); gy++) {
+                        for (int gx = x; gx < std::min(width, x + tileSize); gx++) {
+                            same = same && (tile[(gy - y0)*w + gx - x0] == whole[gy*width + gx]);
+                        }
+                    }
+                    CHECK(same);
+                }
+            }
+        }
+    }
+}//end TestTileWithHalo
+
+///Opening removes specks smaller than the element; closing fills small holes
+void TestOpenAndClose() {
+    const int width = 20, height = 20;
+    std::vector<std::uint8_t> speck(width * height, 0);
+    speck[10*width + 10] = 1;
+    MaskMorphology(MaskMorphology::OPEN, 1).Apply(speck, width, height);
+    CHECK(std::count(speck.begin(), speck.end(), 1) == 0);
+
+    std::vector<std::uint8_t> hole(width * height, 1);
+    hole[10*width + 10] = 0;
+    MaskMorphology(MaskMorphology::CLOSE, 1).Apply(hole, width, height);
+    CHECK(std::count(hole.begin(), hole.end(), 0) == 0);
+}//end TestOpenAndClose
+
+///Inactive operations leave the mask alone and need no halo
+void TestInactive() {
+    std::mt19937 random(3);
+    auto mask = RandomMask(40, 10, 0.5, random);
+    auto original = mask;
+    MaskMorphology none(MaskMorphology::NONE, 3), zero(MaskMorphology::OPEN, 0);
+    CHECK(!none.IsActive() && (0 == none.GetHalo()));
+    CHECK(!zero.IsActive() && (0 == zero.GetHalo()));
+    none.Apply(mask, 40, 10);
+    zero.Apply(mask, 40, 10);
+    CHECK(mask == original);
+    CHECK(4 == MaskMorphology(MaskMorphology::CLOSE, 2).GetHalo());
+    CHECK(2 == MaskMorphology(MaskMorphology::ERODE, 2).GetHalo());
+}//end TestInactive
+
+}//end namespace
+
+int main() {
+    TestMatchesNaive();
+    TestTileWithHalo();
+    TestOpenAndClose();
+    TestInactive();
+    return TestResult();
+}//end main
@@ -0,0 +1,132 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//MaskPyramid: cell coverage of every level, and counts of slides larger than 2^32 pixels
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "MaskPyramid.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Coverage of every cell of every level, against counting the mask directly
+void TestCoverageMatchesMask() {
+    std::mt19937 random(11);
+    std::bernoulli_distribution retained(0.3);
+    const int width = 100, height = 37, tileSize = 16;
+    std::vector<std::uint8_t> mask(width * height);
+    for (auto &m : mask) { m = retained(random) ? 1 : 0; }
+
+    MaskPyramid pyramid(width, height, 64);
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            int w = std::min(tileSize, width - x), h = std::min(tileSize, height - y);
+            std::vector<std::uint8_t> tile(w * h);
+            for (int ty = 0; ty < h; ty++) {
+                std::copy_n(mask.begin() + (y + ty)*width + x, w, tile.begin() + ty*w);
+            }
+            pyramid.AddTile(x, y, w, h, tile);
+        }
+    }
+    pyramid.Build();
+    CHECK(pyramid.GetLevelWidth(0) * pyramid.GetLevelHeight(0) <= 64);
+    CHECK(1 == pyramid.GetLevelWidth(pyramid.GetNumLevels() - 1));
+    CHECK(1 == pyramid.GetLevelHeight(pyramid.GetNumLevels() - 1));
+
+    for (int level = 0; level < pyramid.GetNumLevels(); level++) {
+        int factor = pyramid.GetLevelFactor(level);
+        for (int cy = 0; cy < pyramid.GetLevelHeight(level); cy++) {
+            for (int cx = 0; cx < pyramid.GetLevelWidth(level); cx++) {
+                int count = 0, pixels = 0;
+                for (int y = cy * factor; y < std::min(height, (cy + 1) * factor); y++) {
+                    for (int x = cx * factor; x < std::min(width, (cx + 1) * factor); x++) {
+                        count += mask[y*width + x];
+                        pixels++;
+                    }
+                }
+                double coverage = static_cast<double>(count) / pixels;
+                CHECK_NEAR(pyramid.GetValue(level, cx, cy, MaskPyramid::COVERAGE), coverage, 1e-12);
+                CHECK(pyramid.GetValue(level, cx, cy, MaskPyramid::MAJORITY) == ((coverage >= 0.5) ? 1.0 : 0.0));
+            }
+        }
+    }
+}//end TestCoverageMatchesMask
+
+///Pixels added and removed one at a time update the counts after Build()
+void TestAddPixel() {
+    MaskPyramid pyramid(8, 8, 64);
+    pyramid.AddUniformTile(0, 0, 8, 8, true);
+    pyramid.AddPixel(3, 3, -1);
+    pyramid.Build();
+    int top = pyramid.GetNumLevels() - 1;
+    CHECK_NEAR(pyramid.GetCoverage(top, 0, 0), 63.0 / 64.0, 1e-12);
+    CHECK_NEAR(pyramid.GetCoverage(0, 3, 3), 0.0, 1e-12);
+    pyramid.AddPixel(3, 3, 1);
+    pyramid.Build();
+    CHECK_NEAR(pyramid.GetCoverage(top, 0, 0), 1.0, 1e-12);
+}//end TestAddPixel
+
+///A fully retained 2^17 x 2^17 slide: the coarse cells hold more than 2^32 pixels
+void TestCountsBeyond32Bits() {
+    const int size = 1 << 17;
+    MaskPyramid pyramid(size, size, 16);
+    CHECK(4 == pyramid.GetLevelWidth(0));
+    const int tileSize = 1 << 15;
+    for (int y = 0; y < size; y += tileSize) {
+        for (int x = 0; x < size; x += tileSize) {
+            pyramid.AddUniformTile(x, y, tileSize, tileSize, true);
+        }
+    }
+    pyramid.Build();
+    CHECK(3 == pyramid.GetNumLevels());
+    for (int level = 0; level < pyramid.GetNumLevels(); level++) {
+        CHECK_NEAR(pyramid.GetCoverage(level, 0, 0), 1.0, 1e-12);
+    }
+}//end TestCountsBeyond32Bits
+
+///The finest level whose factor does not exceed the display's downsampling
+void TestSelectLevel() {
+    MaskPyramid pyramid(1024, 1024, 64 * 64);
+    pyramid.Build();
+    CHECK(16 == pyramid.GetLevelFactor(0));
+    CHECK(-1 == pyramid.SelectLevel(8.0));
+    CHECK(0 == pyramid.SelectLevel(16.0));
+    CHECK(0 == pyramid.SelectLevel(31.0));
+    CHECK(1 == pyramid.SelectLevel(32.0));
+    CHECK(pyramid.GetNumLevels() - 1 == pyramid.SelectLevel(1e6));
+}//end TestSelectLevel
+
+}//end namespace
+
+int main() {
+    TestCoverageMatchesMask();
+    TestAddPixel();
+    TestCountsBeyond32Bits();
+    TestSelectLevel();
+    return TestResult();
+}//end main
@@ -0,0 +1,109 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//ODConversion: per-channel white points, linearization curves folded into the tables, and the inverse lookup
+
+#include <array>
+#include <cmath>
+
+#include "ODConversion.h"
+#include "TestCheck.h"
+
+namespace {
+
+void TestDefault() {
+    ODConversion converter;
+    CHECK(0.0 == converter.LookupRGBtoOD(255, 0));
+    CHECK_NEAR(converter.LookupRGBtoOD(100, 1), -std::log10(100.0 / 255.0), 1e-12);
+    //Black is finite
+    CHECK(std::isfinite(converter.LookupRGBtoOD(0, 2)));
+    for (int ch = 0; ch < 3; ch++) {
+        CHECK(converter.LookupRGBtoOD(37, ch) == converter.LookupRGBtoOD(37));
+    }
+}//end TestDefault
+
+void TestWhitePoint() {
+    ODConversion converter({ 240.0, 250.0, 255.0 });
+    //The white point has zero OD, and brighter values are clamped to zero
+    CHECK(0.0 == converter.LookupRGBtoOD(240, 0));
+    CHECK(0.0 == converter.LookupRGBtoOD(245, 0));
+    CHECK_NEAR(converter.LookupRGBtoOD(125, 1), -std::log10(125.0 / 250.0), 1e-12);
+    CHECK(converter != ODConversion());
+    CHECK(converter == ODConversion({ 240.0, 250.0, 255.0 }));
+}//end TestWhitePoint
+
+void TestCurves() {
+    ODConversion::Curve srgb = ODConversion::SRGBCurve();
+    CHECK(256 == srgb.size());
+    CHECK(0.0 == srgb[0]);
+    CHECK_NEAR(1.0, srgb[255], 1e-12);
+    //The linear segment near black, and the power segment above it
+    CHECK_NEAR(srgb[10], (10.0 / 255.0) / 12.92, 1e-12);
+    CHECK_NEAR(srgb[128], std::pow((128.0 / 255.0 + 0.055) / 1.055, 2.4), 1e-12);
+    ODConversion::Curve gamma = ODConversion::GammaCurve(2.2);
+    CHECK_NEAR(gamma[128], std::pow(128.0 / 255.0, 2.2), 1e-12);
+
+    //A linearized channel's OD is that of its linear intensity; the others are unchanged
+    ODConversion converter(ODConversion::GetDefaultWhitePoint(), { { gamma, ODConversion::Curve(), srgb } });
+    CHECK_NEAR(converter.LookupRGBtoOD(128, 0), -std::log10(gamma[128]), 1e-12);
+    CHECK(converter.LookupRGBtoOD(128, 1) == ODConversion().LookupRGBtoOD(128, 1));
+    CHECK_NEAR(converter.LookupRGBtoOD(200, 2), -std::log10(srgb[200]), 1e-12);
+    //Linearizing raises the OD of mid tones
+    CHECK(converter.LookupRGBtoOD(128, 0) > converter.LookupRGBtoOD(128, 1));
+    //Values between entries are interpolated
+    CHECK_NEAR(converter.Linearize(0, 128.5), 0.5 * (gamma[128] + gamma[129]) * 255.0, 1e-9);
+    CHECK(converter != ODConversion());
+}//end TestCurves
+
+void TestDeepValues() {
+    ODConversion converter({ 250.0, 255.0, 255.0 }, { { ODConversion::GammaCurve(2.0),
+        ODConversion::Curve(), ODConversion::Curve() } });
+    //Values beyond the table are converted directly instead of failing
+    CHECK(0.0 == converter.LookupRGBtoOD(1000, 0));
+    CHECK(converter.Linearize(0, 1000.0) == 1000.0);
+    CHECK(0.0 == converter.LookupRGBtoOD(300, 1));
+}//end TestDeepValues
+
+void TestInverse() {
+    ODConversion converter({ 230.0, 255.0, 255.0 }, { { ODConversion::SRGBCurve(),
+        ODConversion::Curve(), ODConversion::Curve() } });
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 1; v <= 230; v++) {
+            CHECK(v == converter.LookupODtoRGB(converter.LookupRGBtoOD(v, ch), ch));
+        }
+    }
+    //OD below that of the white point maps to the top of the scale
+    CHECK(255 == converter.LookupODtoRGB(-1.0, 1));
+}//end TestInverse
+
+}//end namespace
+
+int main() {
+    TestDefault();
+    TestWhitePoint();
+    TestCurves();
+    TestDeepValues();
+    TestInverse();
+    return TestResult();
+}//end main
@@ -0,0 +1,131 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//Threshold selection of ODHistogram: Otsu, triangle and percentile
+
+#include "ODHistogram.h"
+#include "TestCheck.h"
+
+namespace {
+
+///Add _count values at the center of a bin
+void AddToBin(ODHistogram &_histogram, const int &_bin, const int &_count) {
+    double od = (_bin + 0.5) * _histogram.GetBinWidth();
+    for (int i = 0; i < _count; i++) { _histogram.Add(od); }
+}//end AddToBin
+
+///Otsu's threshold falls in the gap between two separated modes
+void TestOtsuSplitsTwoModes() {
+    ODHistogram histogram(2.0, 200);
+    for (int bin = 25; bin <= 35; bin++) { AddToBin(histogram, bin, 100); }
+    for (int bin = 110; bin <= 130; bin++) { AddToBin(histogram, bin, 40); }
+    double threshold = histogram.GetOtsuThreshold();
+    CHECK(threshold >= 36 * histogram.GetBinWidth() - 1e-9);
+    CHECK(threshold <= 110 * histogram.GetBinWidth() + 1e-9);
+    //The threshold is a bin edge, so higher retention counts exactly the upper mode
+    std::int64_t count = 0;
+    double odSum = 0.0;
+    histogram.GetRetained(threshold, true, count, odSum);
+    CHECK(21 * 40 == count);
+    histogram.GetRetained(threshold, false, count, odSum);
+    CHECK(11 * 100 == count);
+}//end TestOtsuSplitsTwoModes
+
+///Otsu's threshold of an unequal pair of single-bin modes is still the edge between them
+void TestOtsuUnequalModes() {
+    ODHistogram histogram(1.0, 100);
+    AddToBin(histogram, 20, 5000);
+    AddToBin(histogram, 60, 50);
+    double threshold = histogram.GetOtsuThreshold();
+    CHECK(threshold > 20.5 * histogram.GetBinWidth());
+    CHECK(threshold <= 60 * histogram.GetBinWidth() + 1e-9);
+}//end TestOtsuUnequalModes
+
+///Histograms with nothing to split give a threshold of zero
+void TestOtsuDegenerate() {
+    ODHistogram empty(1.0, 100);
+    CHECK_NEAR(empty.GetOtsuThreshold(), 0.0, 1e-12);
+    ODHistogram single(1.0, 100);
+    AddToBin(single, 40, 10);
+    CHECK_NEAR(single.GetOtsuThreshold(), 0.0, 1e-12);
+}//end TestOtsuDegenerate
+
+///The triangle threshold splits just past the peak, on the side of the long tail
+void TestTriangleFollowsTail() {
+    //Peak at the low end, flat tail toward high OD
+    ODHistogram high(1.0, 100);
+    AddToBin(high, 5, 1000);
+    for (int bin = 6; bin < 100; bin++) { AddToBin(high, bin, 10); }
+    CHECK_NEAR(high.GetTriangleThreshold(), 7 * high.GetBinWidth(), 1e-9);
+
+    //The mirror image: the split is at the near edge of the chosen bin
+    ODHistogram low(1.0, 100);
+    AddToBin(low, 94, 1000);
+    for (int bin = 0; bin < 94; bin++) { AddToBin(low, bin, 10); }
+    CHECK_NEAR(low.GetTriangleThreshold(), 93 * low.GetBinWidth(), 1e-9);
+}//end TestTriangleFollowsTail
+
+///The triangle threshold of degenerate histograms
+void TestTriangleDegenerate() {
+    ODHistogram empty(1.0, 100);
+    CHECK_NEAR(empty.GetTriangleThreshold(), 0.0, 1e-12);
+    ODHistogram single(1.0, 100);
+    AddToBin(single, 40, 10);
+    CHECK_NEAR(single.GetTriangleThreshold(), 40 * single.GetBinWidth(), 1e-9);
+}//end TestTriangleDegenerate
+
+///Percentiles are interpolated within a bin
+void TestPercentileInterpolates() {
+    //One value per bin: the percentile maps linearly onto the OD range
+    ODHistogram uniform(1.0, 100);
+    for (int bin = 0; bin < 100; bin++) { AddToBin(uniform, bin, 1); }
+    CHECK_NEAR(uniform.GetPercentileThreshold(0.0), 0.0, 1e-9);
+    CHECK_NEAR(uniform.GetPercentileThreshold(25.0), 0.25, 1e-9);
+    CHECK_NEAR(uniform.GetPercentileThreshold(50.0), 0.50, 1e-9);
+    CHECK_NEAR(uniform.GetPercentileThreshold(100.0), 1.0, 1e-9);
+    //Out of range percentages are clamped
+    CHECK_NEAR(uniform.GetPercentileThreshold(-10.0), 0.0, 1e-9);
+    CHECK_NEAR(uniform.GetPercentileThreshold(150.0), 1.0, 1e-9);
+
+    //A quarter of the values in one bin: halfway through that bin is the 12.5th percentile
+    ODHistogram skewed(1.0, 10);
+    AddToBin(skewed, 2, 100);
+    AddToBin(skewed, 7, 300);
+    CHECK_NEAR(skewed.GetPercentileThreshold(12.5), 0.25, 1e-9);
+    CHECK_NEAR(skewed.GetPercentileThreshold(25.0), 0.3, 1e-9);
+    //Empty bins between the modes are skipped
+    CHECK_NEAR(skewed.GetPercentileThreshold(62.5), 0.75, 1e-9);
+}//end TestPercentileInterpolates
+
+}//end namespace
+
+int main() {
+    TestOtsuSplitsTwoModes();
+    TestOtsuUnequalModes();
+    TestOtsuDegenerate();
+    TestTriangleFollowsTail();
+    TestTriangleDegenerate();
+    TestPercentileInterpolates();
+    return TestResult();
+}//end main
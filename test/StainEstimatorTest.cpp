@@ -0,0 +1,97 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//StainEstimator: recovering the stain vectors of synthetic two-stain mixtures
+
+#include <random>
+
+#include "StainEstimator.h"
+#include "TestCheck.h"
+
+namespace {
+
+inline double Dot(const StainMatrix::Vector &_u, const StainMatrix::Vector &_v) {
+    return _u[0] * _v[0] + _u[1] * _v[1] + _u[2] * _v[2];
+}//end Dot
+
+///Pixels that are random amounts of two stains, with a little noise
+void AddMixtures(StainEstimator &_estimator, const StainMatrix::Vector &_stain1, const StainMatrix::Vector &_stain2,
+    const int &_count, std::mt19937 &_random) {
+    std::uniform_real_distribution<double> amount(0.0, 2.0);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    auto s1 = StainMatrix::Normalize(_stain1), s2 = StainMatrix::Normalize(_stain2);
+    for (int i = 0; i < _count; i++) {
+        double a = amount(_random), b = amount(_random);
+        StainMatrix::Vector od;
+        for (int c = 0; c < 3; c++) { od[c] = a * s1[c] + b * s2[c] + noise(_random); }
+        _estimator.Add(od);
+    }
+}//end AddMixtures
+
+///Hematoxylin and eosin are recovered, hematoxylin first
+void TestHematoxylinEosin() {
+    std::mt19937 random(5);
+    StainEstimator estimator;
+    //Added with eosin first, to check the order of the result
+    AddMixtures(estimator, StainMatrix::Eosin(), StainMatrix::Hematoxylin(), 20000, random);
+    StainMatrix::Vector stain1, stain2;
+    CHECK(estimator.Estimate(stain1, stain2));
+    CHECK_NEAR(Dot(stain1, stain1), 1.0, 1e-9);
+    CHECK_NEAR(Dot(stain2, stain2), 1.0, 1e-9);
+    CHECK(Dot(stain1, StainMatrix::Normalize(StainMatrix::Hematoxylin())) > 0.995);
+    CHECK(Dot(stain2, StainMatrix::Normalize(StainMatrix::Eosin())) > 0.995);
+}//end TestHematoxylinEosin
+
+///Hematoxylin and DAB are recovered, hematoxylin first
+void TestHematoxylinDAB() {
+    std::mt19937 random(6);
+    StainEstimator estimator;
+    AddMixtures(estimator, StainMatrix::Hematoxylin(), StainMatrix::DAB(), 20000, random);
+    StainMatrix::Vector stain1, stain2;
+    CHECK(estimator.Estimate(stain1, stain2));
+    CHECK(Dot(stain1, StainMatrix::Normalize(StainMatrix::Hematoxylin())) > 0.995);
+    CHECK(Dot(stain2, StainMatrix::Normalize(StainMatrix::DAB())) > 0.995);
+}//end TestHematoxylinDAB
+
+///Light pixels are not samples, and too few samples give no estimate
+void TestTooFewSamples() {
+    StainEstimator estimator(0.15);
+    for (int i = 0; i < 1000; i++) { estimator.Add({ 0.1, 0.5, 0.5 }); }
+    CHECK(0 == estimator.GetNumSamples());
+    for (std::size_t i = 1; i < StainEstimator::GetMinSamples(); i++) { estimator.Add({ 0.5, 0.5, 0.5 }); }
+    StainMatrix::Vector stain1 = { 1.0, 2.0, 3.0 }, stain2 = stain1;
+    CHECK(!estimator.Estimate(stain1, stain2));
+    estimator.Add({ 0.6, 0.5, 0.4 });
+    CHECK(StainEstimator::GetMinSamples() == estimator.GetNumSamples());
+    CHECK(estimator.Estimate(stain1, stain2));
+}//end TestTooFewSamples
+
+}//end namespace
+
+int main() {
+    TestHematoxylinEosin();
+    TestHematoxylinDAB();
+    TestTooFewSamples();
+    return TestResult();
+}//end main
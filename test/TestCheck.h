@@ -0,0 +1,66 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_TEST_TESTCHECK_H
+#define SEDEEN_SRC_PLUGINS_OPTICALDENSITYTHRESHOLD_TEST_TESTCHECK_H
+
+#include <cmath>
+#include <iostream>
+
+///Minimal checks for the unit tests of the plugin's helpers
+//
+///A failed check prints its location and the test program carries on, so one run
+///lists every failure. main() returns TestResult(), which ctest reads.
+
+///Number of failed checks in this test program
+inline int& FailureCount() {
+    static int count = 0;
+    return count;
+}//end FailureCount
+
+///Print a failed check
+inline void ReportFailure(const char *_file, const int &_line, const char *_expression) {
+    std::cerr << _file << "(" << _line << "): check failed: " << _expression << std::endl;
+    FailureCount()++;
+}//end ReportFailure
+
+///Exit code of the test program
+inline int TestResult() {
+    if (0 == FailureCount()) {
+        std::cout << "All checks passed" << std::endl;
+        return 0;
+    }
+    std::cerr << FailureCount() << " check(s) failed" << std::endl;
+    return 1;
+}//end TestResult
+
+#define CHECK(condition) \
+    do { if (!(condition)) { ReportFailure(__FILE__, __LINE__, #condition); } } while (false)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { if (!(std::abs((actual) - (expected)) <= (tolerance))) { \
+        ReportFailure(__FILE__, __LINE__, #actual " near " #expected); \
+        std::cerr << "    actual " << (actual) << ", expected " << (expected) << std::endl; } } while (false)
+
+#endif
@@ -0,0 +1,98 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2021 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+//WhitePointEstimator: the white point is the background's color, and slides without background give none
+
+#include <array>
+#include <random>
+
+#include "WhitePointEstimator.h"
+#include "TestCheck.h"
+
+namespace {
+
+///A tenth of the pixels are slightly noisy background, the rest darker tissue
+void TestBackgroundAndTissue() {
+    std::mt19937 random(8);
+    std::uniform_int_distribution<int> noise(-2, 2), tissue(40, 200);
+    const std::array<int, 3> background = { 232, 240, 225 };
+    WhitePointEstimator estimator(255, 5.0);
+    for (int i = 0; i < 100000; i++) {
+        if (0 == i % 10) {
+            estimator.Add({ background[0] + noise(random), background[1] + noise(random), background[2] + noise(random) });
+        }
+        else {
+            estimator.Add({ tissue(random), tissue(random), tissue(random) });
+        }
+    }
+    CHECK(100000 == estimator.GetNumPixels());
+    std::array<double, 3> whitePoint = { 0.0, 0.0, 0.0 };
+    CHECK(estimator.Estimate(whitePoint));
+    for (int ch = 0; ch < 3; ch++) {
+        CHECK_NEAR(whitePoint[ch], static_cast<double>(background[ch]), 2.0);
+    }
+}//end TestBackgroundAndTissue
+
+///Values beyond the channel range are clamped, here to a 16-bit scale
+void TestClampsToScale() {
+    WhitePointEstimator estimator(65535, 50.0);
+    estimator.Add({ 70000, 65535, 60000 });
+    estimator.Add({ -5, 0, 0 });
+    std::array<double, 3> whitePoint = { 0.0, 0.0, 0.0 };
+    CHECK(estimator.Estimate(whitePoint));
+    CHECK_NEAR(whitePoint[0], 65535.0, 1e-9);
+    CHECK_NEAR(whitePoint[1], 65535.0, 1e-9);
+    CHECK_NEAR(whitePoint[2], 60000.0, 1e-9);
+}//end TestClampsToScale
+
+///No pixels, or no pixels brighter than half the scale, leave the white point unchanged
+void TestNoBackground() {
+    std::array<double, 3> whitePoint = { 1.0, 2.0, 3.0 };
+    const std::array<double, 3> original = whitePoint;
+    WhitePointEstimator empty;
+    CHECK(!empty.Estimate(whitePoint));
+    CHECK(whitePoint == original);
+
+    std::mt19937 random(9);
+    std::uniform_int_distribution<int> dark(0, 120);
+    WhitePointEstimator tissueOnly;
+    for (int i = 0; i < 10000; i++) { tissueOnly.Add({ dark(random), dark(random), dark(random) }); }
+    CHECK(!tissueOnly.Estimate(whitePoint));
+    CHECK(whitePoint == original);
+
+    //One dark channel is enough to reject the estimate
+    WhitePointEstimator blue;
+    for (int i = 0; i < 100; i++) { blue.Add({ 20, 20, 250 }); }
+    CHECK(!blue.Estimate(whitePoint));
+    CHECK(whitePoint == original);
+}//end TestNoBackground
+
+}//end namespace
+
+int main() {
+    TestBackgroundAndTissue();
+    TestClampsToScale();
+    TestNoBackground();
+    return TestResult();
+}//end main